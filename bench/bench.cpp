@@ -0,0 +1,1199 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "roadmap.h"
+#include "spline.h"
+#include "arclength.h"
+#include "planner.h"
+#include "telemetry.h"
+#include "control.h"
+#include "json.hpp"
+
+using namespace std;
+using namespace carnd;
+
+// Benchmarks of the planner components. All of them run by default, or the
+// ones named on the command line, e.g. ./bench grid. The exit code is not 0
+// when a result differs from its reference implementation.
+
+#ifndef CARND_DATA_DIR
+#define CARND_DATA_DIR "../data"
+#endif
+
+// The replacements of new and delete are not inlined, or GCC pairs the free
+// of an inlined delete with the library new and warns
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+// Allocations of the whole process while counting is on, all the forms of
+// new and delete go to the same malloc and free
+static atomic<bool> counting_allocations(false);
+static atomic<long> allocations(0);
+
+BENCH_NOINLINE void *operator new(size_t size) {
+  if (counting_allocations.load(memory_order_relaxed)) {
+    allocations.fetch_add(1, memory_order_relaxed);
+  }
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+BENCH_NOINLINE void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+BENCH_NOINLINE void operator delete(void *p) noexcept {
+  free(p);
+}
+
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+BENCH_NOINLINE void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+BENCH_NOINLINE void operator delete[](void *p, size_t) noexcept {
+  free(p);
+}
+
+namespace {
+
+  const string highway_map = CARND_DATA_DIR "/highway_map.csv";
+  const string telemetry_frames = CARND_DATA_DIR "/telemetry_frames.txt";
+
+  double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Wiggly loop of n waypoints around (1000, 2000), closed like RoadMap::load
+  void synthetic_map(RoadMap &map, int n) {
+    map.waypoints = waypoints_list();
+    double s = 0, px = 0, py = 0;
+    for (int i = 0; i <= n; i++) {
+      const double a = 2 * M_PI * (i % n) / n;
+      const double r = 1100 + 60 * sin(7 * a);
+      const double x = 1000 + r * cos(a), y = 2000 + r * sin(a);
+      if (i > 0) {
+        s += distance(px, py, x, y);
+      }
+      px = x;
+      py = y;
+      map.waypoints.x.push_back(x);
+      map.waypoints.y.push_back(y);
+      map.waypoints.s.push_back(s);
+      map.waypoints.dx.push_back(cos(a));
+      map.waypoints.dy.push_back(sin(a));
+    }
+    map.max_s = s;
+    map.grid.build(map.waypoints.x, map.waypoints.y);
+  }
+
+  // Closest waypoint with the grid index against the linear scan, for
+  // queries near the road and anywhere around it
+  bool bench_grid() {
+    printf("closet_waypoint, us per query\n");
+    printf("%10s %12s %12s %12s %12s\n", "waypoints", "near scan", "near grid", "any scan", "any grid");
+    int mismatches = 0;
+    for (int n : {1000, 100000, 1000000}) {
+      RoadMap map;
+      synthetic_map(map, n);
+
+      mt19937 gen(1);
+      uniform_real_distribution<double> any_x(-300, 2300), any_y(700, 3300), near(-5, 5);
+      const int queries = n >= 1000000 ? 200 : 2000;
+      printf("%10d", n);
+      for (int near_road = 1; near_road >= 0; near_road--) {
+        vector<double> qx(queries), qy(queries);
+        for (int i = 0; i < queries; i++) {
+          if (near_road) {
+            const int k = gen() % n;
+            qx[i] = map.waypoints.x[k] + near(gen);
+            qy[i] = map.waypoints.y[k] + near(gen);
+          } else {
+            qx[i] = any_x(gen);
+            qy[i] = any_y(gen);
+          }
+        }
+
+        vector<int> scan(queries), grid(queries);
+        const double t0 = now();
+        for (int i = 0; i < queries; i++) {
+          scan[i] = map.closet_waypoint_scan(qx[i], qy[i]);
+        }
+        const double t1 = now();
+        for (int i = 0; i < queries; i++) {
+          grid[i] = map.closet_waypoint(qx[i], qy[i]);
+        }
+        const double t2 = now();
+        for (int i = 0; i < queries; i++) {
+          mismatches += scan[i] != grid[i];
+        }
+        printf(" %12.3f %12.3f", (t1 - t0) / queries * 1e6, (t2 - t1) / queries * 1e6);
+      }
+      printf("\n");
+    }
+    printf("mismatches %d\n", mismatches);
+    return mismatches == 0;
+  }
+
+  // Batch conversions against the scalar ones on 10k points of the highway,
+  // to_xy on random s and to_frenet on a stream of points along the road
+  bool bench_frenet() {
+    RoadMap map;
+    if (!map.load(highway_map)) {
+      return false;
+    }
+
+    const int n = 10000, rounds = 100;
+    mt19937 gen(3);
+    uniform_real_distribution<double> any_s(-100, map.max_s + 100), any_d(0, 12);
+    vector<double> s(n), d(n), x(n), y(n), theta(n);
+    for (int i = 0; i < n; i++) {
+      s[i] = any_s(gen);
+      d[i] = any_d(gen);
+    }
+
+    vector<double> x1(n), y1(n), x2(n), y2(n);
+    double t0 = now();
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < n; i++) {
+        const xy_t xy = map.to_xy(s[i], d[i]);
+        x1[i] = xy.x;
+        y1[i] = xy.y;
+      }
+    }
+    double t1 = now();
+    for (int r = 0; r < rounds; r++) {
+      map.to_xy(s.data(), d.data(), n, x2.data(), y2.data());
+    }
+    double t2 = now();
+    int mismatches = 0;
+    for (int i = 0; i < n; i++) {
+      mismatches += x1[i] != x2[i] || y1[i] != y2[i];
+    }
+    printf("to_xy     scalar %6.1f ns batch %6.1f ns %4.1fx\n",
+           (t1 - t0) / rounds / n * 1e9, (t2 - t1) / rounds / n * 1e9, (t1 - t0) / (t2 - t1));
+
+    // Points along the road heading forward
+    sort(s.begin(), s.end());
+    for (int i = 0; i < n; i++) {
+      const xy_t a = map.to_xy(s[i], d[i]);
+      const xy_t b = map.to_xy(s[i] + 1, d[i]);
+      x[i] = a.x;
+      y[i] = a.y;
+      theta[i] = atan2(b.y - a.y, b.x - a.x);
+    }
+    // The scalar conversions search globally, or follow a cursor as the
+    // batch one does, which leaves the vectorization in the comparison
+    vector<double> s1(n), d1(n), s2(n), d2(n), s3(n), d3(n);
+    t0 = now();
+    for (int r = 0; r < rounds / 4; r++) {
+      for (int i = 0; i < n; i++) {
+        const sd_t sd = map.to_frenet(x[i], y[i], theta[i]);
+        s1[i] = sd.s;
+        d1[i] = sd.d;
+      }
+    }
+    t1 = now();
+    for (int r = 0; r < rounds / 4; r++) {
+      map_cursor cursor;
+      for (int i = 0; i < n; i++) {
+        const sd_t sd = map.to_frenet(x[i], y[i], theta[i], cursor);
+        s3[i] = sd.s;
+        d3[i] = sd.d;
+      }
+    }
+    t2 = now();
+    for (int r = 0; r < rounds / 4; r++) {
+      map.to_frenet(x.data(), y.data(), theta.data(), n, s2.data(), d2.data());
+    }
+    const double t3 = now();
+    // The vectorized projection rounds differently
+    double max_error = 0;
+    for (int i = 0; i < n; i++) {
+      max_error = max(max_error, fabs(s1[i] - s2[i]) + fabs(d1[i] - d2[i]));
+      max_error = max(max_error, fabs(s3[i] - s2[i]) + fabs(d3[i] - d2[i]));
+    }
+    mismatches += max_error > 1e-9;
+    const double per_point = 1e9 / (rounds / 4) / n;
+    printf("to_frenet scalar %6.1f ns cursor %6.1f ns batch %6.1f ns %4.1fx over the cursor, max error %g m\n",
+           (t1 - t0) * per_point, (t2 - t1) * per_point, (t3 - t2) * per_point, (t2 - t1) / (t3 - t2), max_error);
+    printf("mismatches %d\n", mismatches);
+    return mismatches == 0;
+  }
+
+  // Spline map: sampling time, to_xy against the linear segments and the
+  // error against evaluating the spline, for a few resolutions
+  bool bench_spline() {
+    RoadMap linear;
+    if (!linear.load(highway_map)) {
+      return false;
+    }
+
+    const int n = 1000000;
+    mt19937 gen(3);
+    uniform_real_distribution<double> any_s(0, linear.max_s), any_d(0, 12);
+    vector<double> s(n), d(n);
+    for (int i = 0; i < n; i++) {
+      s[i] = any_s(gen);
+      d[i] = any_d(gen);
+    }
+
+    double sum = 0;
+    const double t0 = now();
+    for (int i = 0; i < n; i++) {
+      sum += linear.to_xy(s[i], d[i]).x;
+    }
+    printf("linear to_xy %.1f ns\n", (now() - t0) / n * 1e9);
+
+    printf("%10s %10s %12s %12s %12s %12s\n", "resolution", "samples", "sampling ms", "to_xy ns", "error mm", "wrap mm");
+    bool ok = true;
+    for (double resolution : {0.25, 0.5, 1.0, 2.0}) {
+      RoadMap map;
+      if (!map.load(highway_map)) {
+        return false;
+      }
+      const double t1 = now();
+      map.set_resolution(resolution);
+      const double t2 = now();
+      for (int i = 0; i < n; i++) {
+        sum += map.to_xy(s[i], d[i]).x;
+      }
+      const double t3 = now();
+
+      // The exact point is along the normal of the spline
+      double max_error = 0;
+      for (int i = 0; i < n; i += 10) {
+        const xy_t xy = map.to_xy(s[i], d[i]);
+        const double tx = map.curve.dx(s[i]), ty = map.curve.dy(s[i]), t = norm(tx, ty);
+        const double x = map.curve.x(s[i]) + d[i] * ty / t, y = map.curve.y(s[i]) - d[i] * tx / t;
+        max_error = max(max_error, distance(xy.x, xy.y, x, y));
+      }
+      // The road is continuous across max_s
+      const xy_t before = map.to_xy(map.max_s - 1e-6, 6), after = map.to_xy(map.max_s + 1e-6, 6);
+      const double wrap = distance(before.x, before.y, after.x, after.y);
+      ok &= wrap < 1e-3;
+
+      printf("%10.2f %10zu %12.2f %12.1f %12.3f %12.3f\n", resolution, map.samples.size(),
+             (t2 - t1) * 1e3, (t3 - t2) / n * 1e9, max_error * 1e3, wrap * 1e3);
+    }
+    return ok && sum != 0;
+  }
+
+  // Largest difference between small_spline<N> and tk::spline fitted on
+  // the same anchors, for the values and the derivatives at points inside
+  // and outside of the anchors
+  template <int N>
+  double small_spline_error(const vector<double> &x, const vector<double> &y, tk::spline::bd_type left,
+                            double left_value, tk::spline::bd_type right, double right_value, bool linear,
+                            const vector<double> &at) {
+    tk::spline reference;
+    reference.set_boundary(left, left_value, right, right_value, linear);
+    reference.set_points(x, y);
+    tk::small_spline<N> spline;
+    spline.set_boundary(left, left_value, right, right_value, linear);
+    spline.set_points(x.data(), y.data(), x.size());
+
+    const int n = at.size();
+    vector<double> y0(n), dy0(n), ddy0(n), y1(n), dy1(n), ddy1(n);
+    reference.eval(at.data(), n, y0.data(), dy0.data(), ddy0.data());
+    spline.eval(at.data(), n, y1.data(), dy1.data(), ddy1.data());
+    double error = 0;
+    for (int i = 0; i < n; i++) {
+      error = max(error, fabs(y1[i] - y0[i]));
+      error = max(error, fabs(dy1[i] - dy0[i]));
+      error = max(error, fabs(ddy1[i] - ddy0[i]));
+      error = max(error, fabs(spline(at[i]) - reference(at[i])));
+      for (int order = 1; order <= 3; order++) {
+        error = max(error, fabs(spline.deriv(order, at[i]) - reference.deriv(order, at[i])));
+      }
+    }
+    return error;
+  }
+
+  // small_spline against tk::spline on random anchors in the car frame, as
+  // the planner sets them, for 3 to N anchors and every boundary condition.
+  // The results must agree to 1e-12.
+  bool bench_small_spline() {
+    mt19937 gen(9);
+    uniform_real_distribution<double> any_gap(0.5, 40), any_y(-10, 10), any_slope(-1, 1);
+    const tk::spline::bd_type bounds[] = {tk::spline::second_deriv, tk::spline::first_deriv};
+    const int sets = 10000;
+
+    double error = 0;
+    for (int k = 0; k < sets; k++) {
+      const int n = 3 + k % 6;
+      vector<double> x(n), y(n), at;
+      x[0] = -30 + any_y(gen);
+      y[0] = any_y(gen);
+      for (int i = 1; i < n; i++) {
+        x[i] = x[i - 1] + any_gap(gen);
+        y[i] = any_y(gen);
+      }
+      for (double u = x[0] - 10; u < x[n - 1] + 10; u += 0.7) {
+        at.push_back(u);
+      }
+      const tk::spline::bd_type left = bounds[k % 2], right = bounds[(k / 2) % 2];
+      const double left_value = any_slope(gen), right_value = any_slope(gen);
+      const bool linear = (k / 4) % 2;
+      error = max(error, n <= 5 ? small_spline_error<5>(x, y, left, left_value, right, right_value, linear, at)
+                                : small_spline_error<8>(x, y, left, left_value, right, right_value, linear, at));
+    }
+
+    // Fitting and sampling of the planner's 5 anchors
+    const double x[] = {-2, -1, 30, 60, 90}, y[] = {0.1, 0.05, 2, 4, 4};
+    const vector<double> vx(x, x + 5), vy(y, y + 5);
+    vector<double> at(50), out(50);
+    for (int i = 0; i < 50; i++) {
+      at[i] = 0.6 * i;
+    }
+    const int rounds = 100000;
+    double sum = 0;
+    const double t0 = now();
+    for (int r = 0; r < rounds; r++) {
+      tk::spline reference;
+      reference.set_points(vx, vy);
+      reference.eval(at.data(), 50, out.data());
+      sum += out[r % 50];
+    }
+    const double t1 = now();
+    for (int r = 0; r < rounds; r++) {
+      tk::small_spline<5> spline;
+      spline.set_points(x, y, 5);
+      spline.eval(at.data(), 50, out.data());
+      sum += out[r % 50];
+    }
+    const double t2 = now();
+
+    printf("%d anchor sets: max difference %.3g\n", sets, error);
+    printf("fit and 50 points: spline %.1f ns, small_spline %.1f ns\n", (t1 - t0) / rounds * 1e9,
+           (t2 - t1) / rounds * 1e9);
+    return error <= 1e-12 && sum != 0;
+  }
+
+  // Frenet projection of the points of the spline map, onto the chords
+  // between the waypoints and with the Newton iterations on the reference
+  // line: s, d back from to_frenet and x, y again from to_xy, for random
+  // points and for a stream along the road with a cursor
+  bool bench_newton() {
+    RoadMap map;
+    if (!map.load(highway_map)) {
+      return false;
+    }
+    map.set_resolution(0.5);
+
+    const int n = 100000;
+    mt19937 gen(7);
+    uniform_real_distribution<double> any_s(0, map.max_s), any_d(0, 12);
+    vector<double> s(n), d(n), x(n), y(n), theta(n);
+    for (int i = 0; i < n; i++) {
+      s[i] = any_s(gen);
+      d[i] = any_d(gen);
+    }
+    for (int stream = 0; stream < 2; stream++) {
+      if (stream) {
+        sort(s.begin(), s.end());
+      }
+      for (int i = 0; i < n; i++) {
+        const xy_t a = map.to_xy(s[i], d[i]), b = map.to_xy(s[i] + 1, d[i]);
+        x[i] = a.x;
+        y[i] = a.y;
+        theta[i] = atan2(b.y - a.y, b.x - a.x);
+      }
+
+      printf("%-6s %10s %10s %10s %12s %10s\n", stream ? "stream" : "random", "projection",
+             "s mm", "d mm", "round mm", "ns");
+      for (RoadMap::PROJECTION projection : {RoadMap::PROJECTION::CHORD, RoadMap::PROJECTION::NEWTON}) {
+        map.set_projection(projection);
+        vector<sd_t> sd(n);
+        map_cursor cursor;
+        const double t0 = now();
+        for (int i = 0; i < n; i++) {
+          sd[i] = stream ? map.to_frenet(x[i], y[i], theta[i], cursor) : map.to_frenet(x[i], y[i], theta[i]);
+        }
+        const double ns = (now() - t0) / n * 1e9;
+
+        double s_error = 0, d_error = 0, xy_error = 0;
+        for (int i = 0; i < n; i++) {
+          double ds = fabs(sd[i].s - s[i]);
+          ds = min(ds, fabs(ds - map.max_s));
+          s_error = max(s_error, ds);
+          d_error = max(d_error, fabs(sd[i].d - d[i]));
+          const xy_t back = map.to_xy(sd[i].s, sd[i].d);
+          xy_error = max(xy_error, distance(back.x, back.y, x[i], y[i]));
+        }
+        const bool newton = projection == RoadMap::PROJECTION::NEWTON;
+        printf("%-6s %10s %10.3f %10.3f %12.3f %10.1f\n", "", newton ? "newton" : "chord",
+               s_error * 1e3, d_error * 1e3, xy_error * 1e3, ns);
+        // The samples of the map are within a millimeter of the reference line
+        if (newton && (s_error > 2e-3 || d_error > 2e-3 || xy_error > 2e-3)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Trajectory sampling of create_trajectory, for a lane keep and changes
+  // of one and two lanes: spacing error of the straight line approximation
+  // and of the arc length table, and time per tick against a budget
+  bool bench_arclength() {
+    // A tick is 20 ms, sampling gets 0.1% of it
+    const double v = 22, dt = 0.02, horizon = 30, budget_us = 20;
+    const int n = 50, rounds = 20000;
+    printf("%8s %18s %18s %12s\n", "lane dd", "linear error mm", "arclength error mm", "tick us");
+    double worst_us = 0, worst_error = 0, sum = 0;
+    for (double dd : {0.0, 4.0, 8.0}) {
+      // Anchors in the car frame, like create_trajectory
+      const double anchors_x[5] = {-1, 0, horizon, 2 * horizon, 3 * horizon};
+      const double anchors_y[5] = {0, 0, dd, dd, dd};
+      tk::small_spline<5> spline;
+      spline.set_points(anchors_x, anchors_y, 5);
+
+      // Straight line to the horizon split into equal x steps
+      const double target_y = spline(horizon);
+      const double steps = distance(0, 0, horizon, target_y) / (v * dt);
+      double linear_error = 0, px = 0, py = 0;
+      for (int i = 1; i <= n; i++) {
+        const double x = i * horizon / steps, y = spline(x);
+        linear_error = max(linear_error, fabs(distance(px, py, x, y) - v * dt));
+        px = x;
+        py = y;
+      }
+
+      arc_length_table<16> table;
+      double s[n], x[n], y[n];
+      for (int i = 0; i < n; i++) {
+        s[i] = (i + 1) * v * dt;
+      }
+      const double t0 = now();
+      for (int r = 0; r < rounds; r++) {
+        table.build(spline, 0, horizon);
+        table.inverse(spline, s, n, x);
+        spline.eval(x, n, y);
+        sum += y[n - 1];
+      }
+      const double tick_us = (now() - t0) / rounds * 1e6;
+      double error = 0;
+      px = py = 0;
+      for (int i = 0; i < n; i++) {
+        error = max(error, fabs(distance(px, py, x[i], y[i]) - v * dt));
+        px = x[i];
+        py = y[i];
+      }
+      printf("%8.0f %18.3f %18.6f %12.2f\n", dd, linear_error * 1e3, error * 1e3, tick_us);
+      worst_us = max(worst_us, tick_us);
+      worst_error = max(worst_error, error);
+    }
+    printf("%d points per tick, budget %.0f us\n", n, budget_us);
+    return worst_error < 1e-4 && worst_us < budget_us && sum != 0;
+  }
+
+  // Path along the road from s, d at the speed v, moving to the lane
+  // center d1 with a smooth step over t_change, n points every dt
+  void road_path(const RoadMap &map, double s0, double d0, double v, double d1, double t_change,
+                 int n, double dt, vector<double> &x, vector<double> &y, vector<double> &s) {
+    vector<double> d(n);
+    x.resize(n);
+    y.resize(n);
+    s.resize(n);
+    for (int i = 0; i < n; i++) {
+      const double t = (i + 1) * dt, u = min(t / t_change, 1.0);
+      s[i] = fmod(s0 + v * t, map.max_s);
+      d[i] = d0 + (d1 - d0) * u * u * (3 - 2 * u);
+    }
+    map.to_xy(s.data(), d.data(), n, x.data(), y.data());
+  }
+
+  // Collision checks of candidate paths against the constant velocity
+  // rollouts of the cars around the ego. Stopped behind a car in its lane,
+  // the ego hits it at a 6 m centre gap and not at 7 m, the circles
+  // reaching 6.43 m by default.
+  bool bench_collision() {
+    RoadMap map;
+    if (!map.load(highway_map)) {
+      return false;
+    }
+    const double dt = 0.02, ego_s = 1000, ego_d = 6, ego_v = 20;
+    const int n = 50;
+    Predictor predictor;
+    predictor.n_steps = 50;
+    CollisionChecker checker;
+    vector<double> x, y, s;
+
+    // One car stopped ahead in the ego lane
+    bool ok = true;
+    for (double gap : {6.0, 7.0}) {
+      const double car_s = ego_s + gap, zero = 0, lane_d = ego_d;
+      const int lane = 1, leader = -1;
+      prediction_input_t one = {&car_s, &zero, &zero, &lane_d, &zero, &lane, &leader, 1};
+      predictor.predict(one, map.max_s);
+      checker.prepare(predictor, MODEL_CV, &lane, map, n * dt);
+      road_path(map, ego_s, ego_d, 0, ego_d, 1, n, dt, x, y, s);
+      const bool hit = checker.check(x.data(), y.data(), s.data(), n, dt, dt) >= 0;
+      printf("car %.0f m ahead: %s\n", gap, hit ? "hit" : "clear");
+      ok &= hit == (gap < 6.43);
+    }
+
+    // Cars around the ego
+    mt19937 gen(5);
+    uniform_real_distribution<double> any_s(-40, 100), any_v(14, 22);
+    const int n_cars = 12;
+    vector<double> cars_s(n_cars), cars_v(n_cars), cars_a(n_cars, 0), cars_d(n_cars), cars_d_dot(n_cars, 0);
+    vector<int> cars_lane(n_cars), cars_leader(n_cars, -1);
+    for (int i = 0; i < n_cars; i++) {
+      cars_s[i] = ego_s + any_s(gen);
+      cars_v[i] = any_v(gen);
+      cars_lane[i] = i % 3;
+      cars_d[i] = 2 + 4 * cars_lane[i];
+    }
+    prediction_input_t input = {cars_s.data(), cars_v.data(), cars_a.data(), cars_d.data(),
+                                cars_d_dot.data(), cars_lane.data(), cars_leader.data(), (size_t)n_cars};
+    predictor.predict(input, map.max_s);
+
+    // Lanes x speeds below the ego speed x lane change times
+    vector<vector<double>> paths_x, paths_y, paths_s;
+    for (int lane = 0; lane < 3; lane++) {
+      for (int k = 0; k < 10; k++) {
+        for (int m = 0; m < 10; m++) {
+          road_path(map, ego_s, ego_d, ego_v - 10 + k, 2 + 4 * lane, 1 + 0.3 * m, n, dt, x, y, s);
+          paths_x.push_back(x);
+          paths_y.push_back(y);
+          paths_s.push_back(s);
+        }
+      }
+    }
+    const int candidates = paths_x.size(), rounds = 100;
+    int hits = 0;
+    const double t0 = now();
+    for (int r = 0; r < rounds; r++) {
+      checker.prepare(predictor, MODEL_CV, cars_lane.data(), map, n * dt);
+      hits = 0;
+      for (int c = 0; c < candidates; c++) {
+        hits += checker.check(paths_x[c].data(), paths_y[c].data(), paths_s[c].data(), n, dt, dt) >= 0;
+      }
+    }
+    const double ms = (now() - t0) / rounds * 1e3;
+    printf("%d candidates of %d points, %d cars: %d hits, %.3f ms, %.0f candidates per ms\n",
+           candidates, n, n_cars, hits, ms, candidates / ms);
+    return ok && hits > 0 && hits < candidates;
+  }
+
+  // Tracker updates with a few thousand cars and churn: each tick some cars
+  // leave and new ids arrive, the tracks of the ones gone expire after
+  // max_age and are erased with backward-shift deletion. The tracks seen
+  // recently must be found and the expired ones not, and an update must
+  // take less than 1 ms. The acceleration estimate must stay bounded with
+  // measurements a tiny step apart, and follow a car accelerating at 1 m/s^2.
+  bool bench_tracker() {
+    const int n = 3000, ticks = 1000, leaving = 60;
+    const double dt = 0.02, max_s = 6945.554;
+    Tracker tracker(8192);
+    mt19937 gen(11);
+    uniform_int_distribution<int> any_car(0, n - 1);
+    vector<int> id(n), last_tick(n, -1);
+    vector<double> s(n), d(n), v(n);
+    for (int i = 0; i < n; i++) {
+      id[i] = i;
+      s[i] = i * max_s / n;
+      d[i] = 2 + 4 * (i % 3);
+      v[i] = 15 + i % 10;
+    }
+    int next_id = n;
+
+    vector<double> times(ticks);
+    bool ok = true;
+    for (int k = 0; k < ticks; k++) {
+      for (int j = 0; j < leaving; j++) {
+        const int i = any_car(gen);
+        id[i] = next_id++;
+      }
+      last_tick.resize(next_id, -1);
+      for (int i = 0; i < n; i++) {
+        s[i] = fmod(s[i] + v[i] * dt, max_s);
+        last_tick[id[i]] = k;
+      }
+
+      const double t0 = now();
+      tracker.update(id.data(), s.data(), d.data(), v.data(), n, dt, max_s);
+      times[k] = now() - t0;
+
+      for (int i = 0; i < n; i++) {
+        const track_t *track = tracker.at(i);
+        ok &= track && track->id == id[i] && tracker.find(id[i]) == track;
+      }
+      // Recently seen and long expired ids, on either side of max_age
+      for (int j = 0; j < 200; j++) {
+        const int old = uniform_int_distribution<int>(0, next_id - 1)(gen);
+        if (last_tick[old] < 0) {
+          continue;
+        }
+        const int age = k - last_tick[old];
+        if (age <= 40) {
+          ok &= tracker.find(old) != nullptr;
+        } else if (age >= 60) {
+          ok &= tracker.find(old) == nullptr;
+        }
+      }
+    }
+    ok &= tracker.dropped() == 0;
+
+    sort(times.begin(), times.end());
+    double mean = 0;
+    for (double time : times) {
+      mean += time / ticks;
+    }
+    const double p99 = times[ticks * 99 / 100];
+    printf("%d cars, %d leaving per tick: %zu tracks, %.1f us mean, %.1f us p99, %.1f us max per update\n", n,
+           leaving, tracker.size(), mean * 1e6, p99 * 1e6, times.back() * 1e6);
+    ok &= p99 < 1e-3;
+
+    // Speed noise measured 0.1 ms apart, then a car accelerating at 1 m/s^2
+    Tracker one(1);
+    int car = 0;
+    double car_s = 0, car_d = 6, car_v = 20, worst = 0;
+    for (int k = 0; k < 1000; k++) {
+      const double noisy_v = car_v + (k % 2 ? 0.5 : -0.5);
+      car_s += car_v * 1e-4;
+      one.update(&car, &car_s, &car_d, &noisy_v, 1, 1e-4, max_s);
+      worst = max(worst, fabs(one.at(0)->a));
+    }
+    for (int k = 0; k < 500; k++) {
+      car_s += (car_v + 0.5 * dt) * dt;
+      car_v += dt;
+      one.update(&car, &car_s, &car_d, &car_v, 1, dt, max_s);
+    }
+    const double a = one.at(0)->a;
+    printf("acceleration: %.2f m/s^2 at worst with 0.1 ms steps, %.3f m/s^2 at 1 m/s^2\n", worst, a);
+    ok &= worst <= tracker.max_accel && fabs(a - 1) < 0.05;
+    return ok;
+  }
+
+  // Candidate search of the planner on worker pools of 1, 2, 4 and one
+  // thread per core, among cars around the ego: candidates scored per ms
+  // for the planner's grid and a denser one. Every pool must pick the same
+  // candidate.
+  bool bench_search() {
+    const double ego_s = 1000, ego_d = 6, ego_v = 20, max_s = 6945.554;
+    Predictor predictor;
+    predictor.n_steps = 50;
+    mt19937 gen(13);
+    uniform_real_distribution<double> any_s(-40, 100), any_v(14, 22);
+    const int n_cars = 12;
+    vector<double> cars_s(n_cars), cars_v(n_cars), cars_a(n_cars, 0), cars_d(n_cars), cars_d_dot(n_cars, 0);
+    vector<int> cars_lane(n_cars), cars_leader(n_cars, -1);
+    for (int i = 0; i < n_cars; i++) {
+      cars_s[i] = ego_s + any_s(gen);
+      cars_v[i] = any_v(gen);
+      cars_lane[i] = i % 3;
+      cars_d[i] = 2 + 4 * cars_lane[i];
+    }
+    prediction_input_t input = {cars_s.data(), cars_v.data(), cars_a.data(), cars_d.data(),
+                                cars_d_dot.data(), cars_lane.data(), cars_leader.data(), (size_t)n_cars};
+    predictor.predict(input, max_s);
+
+    TrajectorySearch search;
+    const char lane_feasible[] = {1, 1, 1};
+    search_context_t ctx;
+    ctx.start = {ego_s, ego_v, 0, ego_d, 0, 0};
+    ctx.t_start = 0.4;
+    ctx.n_steps = 20;
+    ctx.max_s = max_s;
+    ctx.speed_limit = 21.9;
+    ctx.max_jerk = search.generator.max_jerk;
+    ctx.lane_width = 4;
+    ctx.safe_gap = 15;
+    ctx.min_gap = 5;
+    ctx.start_lane = 1;
+    ctx.lane_feasible = lane_feasible;
+    ctx.lane_count = 3;
+    ctx.prediction = &predictor;
+    ctx.model = MODEL_CV;
+    ctx.cars_lane = cars_lane.data();
+
+    const int cores = max(1, (int)thread::hardware_concurrency());
+    vector<int> pools = {1, 2, 4, cores};
+    sort(pools.begin(), pools.end());
+    pools.erase(unique(pools.begin(), pools.end()), pools.end());
+
+    const double lanes_d[] = {2, 6, 10};
+    bool ok = true;
+    printf("%d cores\n%10s %8s %12s %10s %8s\n", cores, "candidates", "threads", "search us", "per ms", "speedup");
+    for (int dense = 0; dense < 2; dense++) {
+      vector<double> speeds, horizons;
+      const int n_speeds = dense ? 30 : 10, n_horizons = dense ? 12 : 6;
+      for (int i = 0; i < n_speeds; i++) {
+        speeds.push_back(ego_v * 0.6 + i * (ctx.speed_limit - ego_v * 0.6) / (n_speeds - 1));
+      }
+      for (int i = 0; i < n_horizons; i++) {
+        horizons.push_back(1.0 + i * 3.0 / (n_horizons - 1));
+      }
+      ctx.t_eval = horizons.back();
+
+      int reference = -1;
+      double serial = 0;
+      for (int threads : pools) {
+        WorkerPool workers;
+        workers.start(threads - 1);
+        const int rounds = 200;
+        int best = -1;
+        const double t0 = now();
+        for (int r = 0; r < rounds; r++) {
+          best = search.run(ctx, lanes_d, 3, speeds.data(), n_speeds, horizons.data(), n_horizons, workers);
+        }
+        const double elapsed = (now() - t0) / rounds;
+        if (threads == 1) {
+          reference = best;
+          serial = elapsed;
+        }
+        ok &= best == reference;
+        const int candidates = search.generator.candidates.size();
+        printf("%10d %8d %12.1f %10.0f %8.2f\n", candidates, workers.size(), elapsed * 1e6,
+               candidates / (elapsed * 1e3), serial / elapsed);
+      }
+    }
+    return ok;
+  }
+
+  // Append printf like text to a string
+  void appendf(string &text, const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    text.append(buffer, min(max(n, 0), (int)sizeof(buffer) - 1));
+  }
+
+  // Closed loop on the highway: the part of main.cpp handling a message,
+  // and a simulator driving along the returned path a few points per
+  // message, among cars keeping their lane at constant speed
+  struct closed_loop {
+    PathPlanner planner;
+    TelemetryParser parser;
+    ControlSerializer serializer;
+    ego_t ego;
+    path_t next_path;
+    // Last telemetry message of the simulator
+    string message;
+
+    // Simulator state
+    double x = 909.48, y = 1128.67, yaw = 0, v = 0;
+    path_t path;
+    vector<double> cars_s, cars_d, cars_v;
+
+    bool start() {
+      if (!planner.initialize(highway_map)) {
+        return false;
+      }
+      ego.previous_path.x.reserve(planner.n_path_points);
+      ego.previous_path.y.reserve(planner.n_path_points);
+      ego.cars.reserve(32);
+      next_path.x.reserve(planner.n_path_points);
+      next_path.y.reserve(planner.n_path_points);
+      message.reserve(1 << 14);
+      for (int i = 0; i < 12; i++) {
+        cars_s.push_back(150 + 30 * i);
+        cars_d.push_back(2 + 4 * (i % 3));
+        cars_v.push_back(15 + i % 5);
+      }
+      return true;
+    }
+
+    // Telemetry message of the current state, like the simulator sends
+    void write_telemetry() {
+      const RoadMap &map = planner.roadmap;
+      const sd_t sd = map.to_frenet(x, y, yaw);
+      sd_t end = {0, 0};
+      if (path.size() >= 2) {
+        const size_t n = path.size();
+        end = map.to_frenet(path.x[n - 1], path.y[n - 1],
+                            atan2(path.y[n - 1] - path.y[n - 2], path.x[n - 1] - path.x[n - 2]));
+      }
+
+      message = "42[\"telemetry\",{";
+      appendf(message, "\"x\":%.15g,\"y\":%.15g,\"s\":%.15g,\"d\":%.15g,", x, y, sd.s, sd.d);
+      appendf(message, "\"yaw\":%.15g,\"speed\":%.15g,", rad2deg(yaw), mps2mph(v));
+      for (int k = 0; k < 2; k++) {
+        const vector<double> &values = k == 0 ? path.x : path.y;
+        message += k == 0 ? "\"previous_path_x\":[" : "],\"previous_path_y\":[";
+        for (size_t i = 0; i < values.size(); i++) {
+          appendf(message, i ? ",%.15g" : "%.15g", values[i]);
+        }
+      }
+      appendf(message, "],\"end_path_s\":%.15g,\"end_path_d\":%.15g,\"sensor_fusion\":[", end.s, end.d);
+      for (size_t i = 0; i < cars_s.size(); i++) {
+        const xy_t a = map.to_xy(cars_s[i], cars_d[i]), b = map.to_xy(cars_s[i] + 1, cars_d[i]);
+        const double length = distance(a.x, a.y, b.x, b.y);
+        appendf(message, i ? ",[%d," : "[%d,", (int)i);
+        appendf(message, "%.15g,%.15g,", a.x, a.y);
+        appendf(message, "%.15g,%.15g,", cars_v[i] * (b.x - a.x) / length, cars_v[i] * (b.y - a.y) / length);
+        appendf(message, "%.15g,%.15g]", cars_s[i], cars_d[i]);
+      }
+      message += "]}]";
+    }
+
+    // Handle the message like main.cpp, false if it is rejected
+    bool handle() {
+      frame_t frame;
+      if (!decode_frame(message.data(), message.size(), frame) || !frame.is("telemetry")
+          || !parser.parse(frame.payload, frame.payload + frame.payload_length, ego)) {
+        return false;
+      }
+      planner.run(ego, next_path, 0.02);
+      serializer.write(next_path);
+      return true;
+    }
+
+    // Drive along the returned path for n points
+    void advance(int n) {
+      const int k = min(n, (int)next_path.size());
+      if (k > 0) {
+        const double px = k >= 2 ? next_path.x[k - 2] : x, py = k >= 2 ? next_path.y[k - 2] : y;
+        x = next_path.x[k - 1];
+        y = next_path.y[k - 1];
+        v = distance(px, py, x, y) / 0.02;
+        if (v > 0.05) {
+          yaw = atan2(y - py, x - px);
+        }
+      }
+      path.x.assign(next_path.x.begin() + k, next_path.x.end());
+      path.y.assign(next_path.y.begin() + k, next_path.y.end());
+      for (size_t i = 0; i < cars_s.size(); i++) {
+        cars_s[i] = fmod(cars_s[i] + cars_v[i] * n * 0.02, planner.roadmap.max_s);
+      }
+    }
+
+    // Message, planning and driving
+    bool tick(int n) {
+      write_telemetry();
+      const bool ok = handle();
+      advance(n);
+      return ok;
+    }
+  };
+
+  // Allocations of a tick in steady state, from the received message to
+  // the control message, for each planning mode. A tick must not allocate
+  // after the warm-up.
+  bool bench_alloc() {
+    const int warmup = 50, ticks = 500;
+    // Debug records too, written nowhere
+    FILE *null_output = fopen("/dev/null", "w");
+    if (null_output) {
+      logger().set_output(null_output);
+    }
+    logger().set_level(LEVEL_DEBUG);
+
+    bool ok = true;
+    for (const char *mode : {"spline", "quintic", "search"}) {
+      closed_loop loop;
+      if (!loop.start()) {
+        return false;
+      }
+      if (strcmp(mode, "quintic") == 0) {
+        loop.planner.set_engine(PathPlanner::ENGINE::QUINTIC);
+      } else if (strcmp(mode, "search") == 0) {
+        loop.planner.set_planning(PathPlanner::PLANNING::SEARCH);
+      }
+
+      int rejected = 0;
+      for (int i = 0; i < warmup; i++) {
+        rejected += !loop.tick(3);
+      }
+      long count = 0;
+      double tick_us = 0;
+      for (int i = 0; i < ticks; i++) {
+        loop.write_telemetry();
+        allocations = 0;
+        counting_allocations = true;
+        const double t0 = now();
+        rejected += !loop.handle();
+        tick_us += now() - t0;
+        counting_allocations = false;
+        count += allocations;
+        loop.advance(3);
+      }
+      const sd_t sd = loop.planner.roadmap.to_frenet(loop.x, loop.y, loop.yaw);
+      printf("%-8s %4d ticks %6.1f us per tick, %ld allocations, %d rejected, driven to s %.0f m at %.1f mph\n",
+             mode, ticks, tick_us / ticks * 1e6, count, rejected, sd.s, mps2mph(loop.v));
+      ok &= count == 0 && rejected == 0;
+    }
+
+    logger().flush();
+    logger().set_level(LEVEL_WARN);
+    logger().set_output(stdout);
+    if (null_output) {
+      fclose(null_output);
+    }
+    return ok;
+  }
+
+  // Records logged by several threads at once, into a temporary file: each
+  // record is written whole and the records of a thread in order, or dropped
+  // when the ring is full. Also %c, which has no ll length modifier.
+  bool bench_logger() {
+    FILE *output = tmpfile();
+    if (!output) {
+      return false;
+    }
+    logger().set_output(output);
+    logger().set_level(LEVEL_DEBUG);
+
+    const int n_threads = 4, n = 20000;
+    const size_t dropped = logger().dropped();
+    vector<thread> threads;
+    const double t0 = now();
+    for (int k = 0; k < n_threads; k++) {
+      threads.emplace_back([k]() {
+        for (int i = 0; i < n; i++) {
+          LOG_WARN("thread %c record %d of %s", 'a' + k, i, "logger");
+          // Paced below the rate of the writer, the ring is not meant to be full
+          if (i % 512 == 511) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+          }
+        }
+      });
+    }
+    for (thread &t : threads) {
+      t.join();
+    }
+    const double elapsed = now() - t0;
+    logger().flush();
+    logger().set_level(LEVEL_WARN);
+    logger().set_output(stdout);
+
+    rewind(output);
+    vector<int> last(n_threads, -1);
+    int lines = 0, bad = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), output)) {
+      char c;
+      int i;
+      char name[16];
+      lines++;
+      if (sscanf(line, "thread %c record %d of %15s", &c, &i, name) != 3 || c < 'a' || c >= 'a' + n_threads ||
+          strcmp(name, "logger") != 0 || i <= last[c - 'a']) {
+        bad++;
+        continue;
+      }
+      last[c - 'a'] = i;
+    }
+    fclose(output);
+
+    const long lost = logger().dropped() - dropped;
+    printf("%d threads x %d records: %d written, %ld dropped, %d malformed in %.1f ms\n",
+           n_threads, n, lines, lost, bad, elapsed * 1e3);
+    return bad == 0 && lines + lost == n_threads * n;
+  }
+
+  // Telemetry read from the json DOM, as main.cpp did before the parser
+  void dom_telemetry(const string &message, ego_t &ego) {
+    const nlohmann::json j = nlohmann::json::parse(message.substr(2));
+    const nlohmann::json &t = j[1];
+    ego.x = t["x"];
+    ego.y = t["y"];
+    ego.s = t["s"];
+    ego.d = t["d"];
+    ego.yaw = deg2rad(t["yaw"]);
+    ego.v = mph2mps(t["speed"]);
+    ego.previous_path.x.clear();
+    ego.previous_path.y.clear();
+    for (auto &x : t["previous_path_x"]) {
+      ego.previous_path.x.push_back(x);
+    }
+    for (auto &y : t["previous_path_y"]) {
+      ego.previous_path.y.push_back(y);
+    }
+    ego.end_path.s = t["end_path_s"];
+    ego.end_path.d = t["end_path_d"];
+    const nlohmann::json &sensor_fusion = t["sensor_fusion"];
+    ego.cars.resize(sensor_fusion.size());
+    for (size_t i = 0; i < sensor_fusion.size(); i++) {
+      const nlohmann::json &car = sensor_fusion[i];
+      ego.cars.id[i] = car[0].get<int>();
+      ego.cars.x[i] = car[1];
+      ego.cars.y[i] = car[2];
+      ego.cars.vx[i] = car[3];
+      ego.cars.vy[i] = car[4];
+      ego.cars.s[i] = car[5];
+      ego.cars.d[i] = car[6];
+    }
+  }
+
+  bool same_telemetry(const ego_t &a, const ego_t &b) {
+    return a.x == b.x && a.y == b.y && a.s == b.s && a.d == b.d && a.yaw == b.yaw && a.v == b.v
+      && a.previous_path.x == b.previous_path.x && a.previous_path.y == b.previous_path.y
+      && a.end_path.s == b.end_path.s && a.end_path.d == b.end_path.d
+      && a.cars.id == b.cars.id && a.cars.x == b.cars.x && a.cars.y == b.cars.y
+      && a.cars.vx == b.cars.vx && a.cars.vy == b.cars.vy && a.cars.s == b.cars.s && a.cars.d == b.cars.d;
+  }
+
+  // Telemetry frames of the closed loop, one per line, parsed from the
+  // json DOM and by the telemetry parser. The values must be the same.
+  bool bench_telemetry() {
+    ifstream in(telemetry_frames);
+    vector<string> frames;
+    string line;
+    size_t bytes = 0;
+    while (getline(in, line)) {
+      if (!line.empty()) {
+        frames.push_back(line);
+        bytes += line.size();
+      }
+    }
+    if (frames.empty()) {
+      printf("no frames in %s\n", telemetry_frames.c_str());
+      return false;
+    }
+
+    const int rounds = 200;
+    ego_t dom, ego;
+    TelemetryParser parser;
+    int mismatches = 0;
+    for (const string &frame : frames) {
+      frame_t f;
+      dom_telemetry(frame, dom);
+      mismatches += !decode_frame(frame.data(), frame.size(), f)
+        || !parser.parse(f.payload, f.payload + f.payload_length, ego) || !same_telemetry(dom, ego);
+    }
+
+    double t0 = now();
+    for (int r = 0; r < rounds; r++) {
+      for (const string &frame : frames) {
+        dom_telemetry(frame, dom);
+      }
+    }
+    double t1 = now();
+    for (int r = 0; r < rounds; r++) {
+      for (const string &frame : frames) {
+        frame_t f;
+        decode_frame(frame.data(), frame.size(), f);
+        parser.parse(f.payload, f.payload + f.payload_length, ego);
+      }
+    }
+    double t2 = now();
+    const double n = (double)rounds * frames.size();
+    printf("%zu frames, %.0f bytes on average\n", frames.size(), (double)bytes / frames.size());
+    printf("json DOM %7.2f us parser %7.2f us per frame, %4.1fx\n",
+           (t1 - t0) / n * 1e6, (t2 - t1) / n * 1e6, (t1 - t0) / (t2 - t1));
+    printf("mismatches %d\n", mismatches);
+    return mismatches == 0;
+  }
+
+  // Same to_xy on a few points of the track
+  bool same_road(const RoadMap &a, const RoadMap &b) {
+    if (a.waypoints.size() != b.waypoints.size()) {
+      return false;
+    }
+    for (double s = 0; s < a.max_s; s += 97) {
+      const xy_t p = a.to_xy(s, 6), q = b.to_xy(s, 6);
+      if (distance(p.x, p.y, q.x, q.y) > 1e-9) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Startup time of the csv and binary maps, and reloads: a csv after a
+  // binary map owns its tables, an empty csv or a truncated binary map
+  // leaves the map as it was
+  bool bench_load() {
+    const string binary_map = "bench_map.bin", empty_map = "bench_empty.csv", truncated_map = "bench_truncated.bin";
+    RoadMap csv;
+    csv.resolution = 0.5;
+    const double t0 = now();
+    if (!csv.load(highway_map) || !csv.save(binary_map)) {
+      return false;
+    }
+    const double t1 = now();
+    RoadMap map;
+    if (!map.load(binary_map)) {
+      return false;
+    }
+    const double t2 = now();
+    printf("csv %.2f ms binary %.3f ms\n", (t1 - t0) * 1e3, (t2 - t1) * 1e3);
+    fclose(fopen(empty_map.c_str(), "w"));
+    FILE *in = fopen(binary_map.c_str(), "rb"), *out = fopen(truncated_map.c_str(), "wb");
+    char head[300];
+    fwrite(head, 1, fread(head, 1, sizeof(head), in), out);
+    fclose(in);
+    fclose(out);
+
+    int failures = 0;
+    const bool binary_ok = same_road(map, csv) && map.waypoints.x.attached();
+    failures += !binary_ok;
+    // Rejected files
+    const bool empty_ok = !map.load(empty_map) && same_road(map, csv) && map.waypoints.x.attached();
+    failures += !empty_ok;
+    const bool truncated_ok = !map.load(truncated_map) && same_road(map, csv);
+    failures += !truncated_ok;
+    // Back to the csv, the mapped file is released
+    const bool reload_ok = map.load(highway_map) && same_road(map, csv)
+      && !map.waypoints.x.attached() && !map.segments.x.attached() && !map.samples.x.attached()
+      && map.file == nullptr;
+    failures += !reload_ok;
+    printf("binary %s, empty csv %s, truncated binary %s, csv after binary %s\n", binary_ok ? "ok" : "FAILED",
+           empty_ok ? "ok" : "FAILED", truncated_ok ? "ok" : "FAILED", reload_ok ? "ok" : "FAILED");
+
+    remove(binary_map.c_str());
+    remove(empty_map.c_str());
+    remove(truncated_map.c_str());
+    return failures == 0;
+  }
+
+  struct benchmark_t {
+    const char *name;
+    bool (*run)();
+  };
+
+  const benchmark_t benchmarks[] = {
+    {"grid", bench_grid},
+    {"frenet", bench_frenet},
+    {"spline", bench_spline},
+    {"small_spline", bench_small_spline},
+    {"newton", bench_newton},
+    {"arclength", bench_arclength},
+    {"alloc", bench_alloc},
+    {"logger", bench_logger},
+    {"collision", bench_collision},
+    {"tracker", bench_tracker},
+    {"search", bench_search},
+    {"telemetry", bench_telemetry},
+    {"load", bench_load},
+  };
+}
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  for (const benchmark_t &b : benchmarks) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; i++) {
+      selected |= strcmp(argv[i], b.name) == 0;
+    }
+    if (selected) {
+      printf("== %s\n", b.name);
+      ok &= b.run();
+    }
+  }
+  return ok ? 0 : 1;
+}
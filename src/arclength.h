@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Arc length parameterization of a curve y(x), with a table of the
+	// cumulative length at K + 1 evenly spaced x integrated with 5 points
+	// Gauss-Legendre quadrature. The curve is any spline with deriv().
+	template <int K>
+	struct arc_length_table
+	{
+		double x0 = 0;   // start of the table
+		double step = 0; // x distance between the table points
+		array<double, K + 1> length; // cumulative length at x0 + k * step
+
+		double total() const { return length[K]; }
+
+		// Build the table over [x_begin, x_end]
+		template <typename Spline>
+		void build(const Spline &spline, double x_begin, double x_end);
+
+		// x at the n sorted arc lengths s from x0, beyond the table the curve
+		// is extended along its last tangent
+		template <typename Spline>
+		void inverse(const Spline &spline, const double *s, int n, double *x) const;
+
+	private:
+		// Length element of the curve at x
+		template <typename Spline>
+		static double speed(const Spline &spline, double x)
+		{
+			const double dy = spline.deriv(1, x);
+			return sqrt(1 + dy * dy);
+		}
+
+		// Length of the curve over [a, b] with 5 points Gauss-Legendre
+		template <typename Spline>
+		static double integrate(const Spline &spline, double a, double b)
+		{
+			static const double nodes[5] = {
+				0, -0.5384693101056831, 0.5384693101056831, -0.9061798459386640, 0.9061798459386640 };
+			static const double weights[5] = {
+				0.5688888888888889, 0.4786286704993665, 0.4786286704993665, 0.2369268850561891, 0.2369268850561891 };
+
+			const double half = 0.5 * (b - a);
+			const double mid = 0.5 * (a + b);
+			double sum = 0;
+			for (int i = 0; i < 5; i++)
+				sum += weights[i] * speed(spline, mid + half * nodes[i]);
+			return half * sum;
+		}
+	};
+
+	// Build the table over [x_begin, x_end]
+	template <int K>
+	template <typename Spline>
+	void arc_length_table<K>::build(const Spline &spline, double x_begin, double x_end)
+	{
+		x0 = x_begin;
+		step = (x_end - x_begin) / K;
+		length[0] = 0;
+		for (int k = 0; k < K; k++)
+		{
+			const double a = x0 + k * step;
+			length[k + 1] = length[k] + integrate(spline, a, a + step);
+		}
+	}
+
+	// x at the n sorted arc lengths s from x0, following the table with a
+	// cursor and refining the interpolated x with Newton iterations
+	template <int K>
+	template <typename Spline>
+	void arc_length_table<K>::inverse(const Spline &spline, const double *s, int n, double *x) const
+	{
+		const double x_end = x0 + K * step;
+		int k = 0;
+
+		for (int i = 0; i < n; i++)
+		{
+			if (s[i] <= 0)
+			{
+				x[i] = x0;
+				continue;
+			}
+
+			// Beyond the table, extend along the last tangent
+			if (s[i] >= length[K])
+			{
+				x[i] = x_end + (s[i] - length[K]) / speed(spline, x_end);
+				continue;
+			}
+
+			while (k < K - 1 && length[k + 1] < s[i])
+				k++;
+
+			// Interpolate in the table, then solve length(x) = s
+			const double a = x0 + k * step;
+			const double span = length[k + 1] - length[k];
+			double x_ = a + step * (s[i] - length[k]) / span;
+			for (int iter = 0; iter < 2; iter++)
+			{
+				const double f = length[k] + integrate(spline, a, x_) - s[i];
+				x_ -= f / speed(spline, x_);
+			}
+			x[i] = x_;
+		}
+	}
+
+} // namespace carnd
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "roadmap.h"
+#include "predictor.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Collision checker of paths against the rollouts of the cars. The
+	// broadphase compares the s interval of the path over each rollout
+	// step with the s interval of every car, the narrowphase covers the
+	// path point and the car with circles along their heading.
+	class CollisionChecker
+	{
+	public:
+		double ego_length = 5.0; // m
+		double ego_width = 2.0;  // m
+		double car_length = 5.0; // m
+		double car_width = 2.0;  // m
+		int n_circles = 3;       // circles covering a car
+		double margin = 0.5;     // m, between the circles
+
+		// Cars of the rollouts of a model in cartesian coordinates up to the
+		// horizon, the cars with a negative lane are left out
+		void prepare(const Predictor &prediction, int model, const int *cars_lane, const RoadMap &roadmap,
+					 double horizon);
+
+		// First of the n path points hitting a car, -1 if none. The point j
+		// is at the time t0 + j * dt from the rollouts start, s is the s of
+		// each point. The car hit is returned in car if not null.
+		int check(const double *x, const double *y, const double *s, size_t n,
+				  double t0, double dt, int *car = nullptr) const;
+
+	private:
+		// Narrowphase, circles of the ego at x, y along hx, hy against the
+		// j-th prepared car at the step k plus w
+		bool hit(double x, double y, double hx, double hy, size_t j, int k, double w) const;
+
+		// Centre distance of two circles under which they overlap
+		double circle_limit() const;
+		// Distance between the body centres beyond which no circles overlap,
+		// for both phases. It is (ego_length + car_length) / (2 n_circles)
+		// over the farthest circles, which covers the s gaps shorter than
+		// the distances on the inside of the curves.
+		double max_reach() const { return 0.5 * (ego_length + car_length) + circle_limit(); }
+
+		size_t at(int k, size_t j) const { return (size_t)k * cars_.size() + j; }
+
+		double max_s_ = 0;
+		double step_ = 1;
+		int steps_ = 0;
+		vector<int> cars_; // predicted car of each prepared car
+		// Time major s, position and unit heading of the prepared cars
+		vector<double> s_, d_, x_, y_, hx_, hy_;
+	};
+
+	void CollisionChecker::prepare(const Predictor &prediction, int model, const int *cars_lane, const RoadMap &roadmap,
+								   double horizon)
+	{
+		max_s_ = roadmap.max_s;
+		step_ = prediction.step;
+		// At least two steps to interpolate between
+		steps_ = max(2, min(prediction.n_steps, (int)ceil(horizon / step_)) + 1);
+
+		cars_.clear();
+		for (size_t i = 0; i < prediction.size(); i++)
+			if (cars_lane[i] >= 0)
+				cars_.push_back(i);
+
+		const size_t n = (size_t)steps_ * cars_.size();
+		s_.resize(n);
+		d_.resize(n);
+		x_.resize(n);
+		y_.resize(n);
+		hx_.resize(n);
+		hy_.resize(n);
+
+		for (int k = 0; k < steps_; k++)
+		{
+			const float *s = prediction.s_row(model, k);
+			const float *d = prediction.d_row(model, k);
+			for (size_t j = 0; j < cars_.size(); j++)
+			{
+				s_[at(k, j)] = s[cars_[j]];
+				d_[at(k, j)] = d[cars_[j]];
+			}
+		}
+		roadmap.to_xy(s_.data(), d_.data(), n, x_.data(), y_.data());
+
+		// Heading from the motion between the steps, or along the road for
+		// a car standing still
+		for (int k = 0; k < steps_; k++)
+		{
+			const int k0 = k + 1 < steps_ ? k : k - 1;
+			for (size_t j = 0; j < cars_.size(); j++)
+			{
+				const size_t i = at(k, j);
+				double hx = x_[at(k0 + 1, j)] - x_[at(k0, j)];
+				double hy = y_[at(k0 + 1, j)] - y_[at(k0, j)];
+				double length = sqrt(hx * hx + hy * hy);
+				if (length < 0.01)
+				{
+					const xy_t ahead = roadmap.to_xy(s_[i] + 1, d_[i]);
+					hx = ahead.x - x_[i];
+					hy = ahead.y - y_[i];
+					length = sqrt(hx * hx + hy * hy);
+				}
+				hx_[i] = length > 0 ? hx / length : 1;
+				hy_[i] = length > 0 ? hy / length : 0;
+			}
+		}
+
+		// Wrap s for the broadphase
+		for (size_t i = 0; i < n; i++)
+			s_[i] -= floor(s_[i] / max_s_) * max_s_;
+	}
+
+	int CollisionChecker::check(const double *x, const double *y, const double *s, size_t n,
+								double t0, double dt, int *car) const
+	{
+		if (n == 0 || cars_.empty())
+			return -1;
+
+		// s gap under which the bodies may overlap, as in the narrowphase
+		const double reach = max_reach();
+		const double half_loop = 0.5 * max_s_;
+
+		size_t first = 0;
+		for (int k = 0; k + 1 < steps_ && first < n; k++)
+		{
+			// Path points during the step, the last step covers the rest
+			const double t_end = (k + 2 < steps_) ? (k + 1) * step_ : INFINITY;
+			size_t last = first;
+			while (last < n && t0 + last * dt < t_end)
+				last++;
+			if (last == first)
+				continue;
+
+			// s interval of the path over the step, relative to its first point
+			const double base = s[first];
+			double lo = 0, hi = 0;
+			for (size_t i = first + 1; i < last; i++)
+			{
+				double ds = s[i] - base;
+				ds += ds < -half_loop ? max_s_ : ds > half_loop ? -max_s_ : 0;
+				lo = min(lo, ds);
+				hi = max(hi, ds);
+			}
+
+			for (size_t j = 0; j < cars_.size(); j++)
+			{
+				// Broadphase, s interval of the car over the step
+				double s0 = s_[at(k, j)] - base;
+				double s1 = s_[at(k + 1, j)] - base;
+				s0 += s0 < -half_loop ? max_s_ : s0 > half_loop ? -max_s_ : 0;
+				s1 += s1 < -half_loop ? max_s_ : s1 > half_loop ? -max_s_ : 0;
+				if (min(s0, s1) > hi + reach || max(s0, s1) < lo - reach)
+					continue;
+
+				// Narrowphase at every path point of the step
+				for (size_t i = first; i < last; i++)
+				{
+					const size_t a = i + 1 < n ? i : i - min(i, (size_t)1);
+					const size_t b = i + 1 < n ? i + 1 : i;
+					double hx = x[b] - x[a], hy = y[b] - y[a];
+					const double length = sqrt(hx * hx + hy * hy);
+					if (length > 0)
+					{
+						hx /= length;
+						hy /= length;
+					}
+					else
+					{
+						hx = hx_[at(k, j)];
+						hy = hy_[at(k, j)];
+					}
+
+					const double w = (t0 + i * dt) / step_ - k;
+					if (hit(x[i], y[i], hx, hy, j, k, w))
+					{
+						if (car)
+							*car = cars_[j];
+						return i;
+					}
+				}
+			}
+			first = last;
+		}
+		return -1;
+	}
+
+	bool CollisionChecker::hit(double x, double y, double hx, double hy, size_t j, int k, double w) const
+	{
+		const size_t p = at(k, j), q = at(k + 1, j);
+		const double cx = x_[p] + w * (x_[q] - x_[p]);
+		const double cy = y_[p] + w * (y_[q] - y_[p]);
+		const double chx = hx_[p] + w * (hx_[q] - hx_[p]);
+		const double chy = hy_[p] + w * (hy_[q] - hy_[p]);
+
+		// Far apart
+		const double dx = cx - x, dy = cy - y;
+		const double reach = max_reach();
+		if (dx * dx + dy * dy > reach * reach)
+			return false;
+
+		// Circles covering each body, spaced along its length
+		const double ego_step = ego_length / n_circles;
+		const double car_step = car_length / n_circles;
+		const double limit = circle_limit();
+
+		for (int a = 0; a < n_circles; a++)
+		{
+			const double ea = (a - 0.5 * (n_circles - 1)) * ego_step;
+			const double ex = x + ea * hx, ey = y + ea * hy;
+			for (int b = 0; b < n_circles; b++)
+			{
+				const double cb = (b - 0.5 * (n_circles - 1)) * car_step;
+				const double ox = cx + cb * chx - ex, oy = cy + cb * chy - ey;
+				if (ox * ox + oy * oy < limit * limit)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	double CollisionChecker::circle_limit() const
+	{
+		// Circles through the corners of the body slices
+		const double ego_step = ego_length / n_circles;
+		const double car_step = car_length / n_circles;
+		const double ego_radius = sqrt(0.25 * ego_step * ego_step + 0.25 * ego_width * ego_width);
+		const double car_radius = sqrt(0.25 * car_step * car_step + 0.25 * car_width * car_width);
+		return ego_radius + car_radius + margin;
+	}
+
+} // namespace carnd
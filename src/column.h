@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cassert>
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Contiguous array of values, either owned or attached to external
+	// memory such as a memory mapped map file. Attached columns are read only.
+	template <typename T>
+	class column
+	{
+	public:
+		column() {}
+		column(const column &other) { *this = other; }
+		column &operator=(const column &other)
+		{
+			store_ = other.store_;
+			attached_ = other.attached_;
+			if (attached_)
+			{
+				data_ = other.data_;
+				size_ = other.size_;
+			}
+			else
+				sync();
+			return *this;
+		}
+
+		size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+		bool attached() const { return attached_; }
+
+		const T *data() const { return data_; }
+		const T *begin() const { return data_; }
+		const T *end() const { return data_ + size_; }
+
+		const T &operator[](size_t i) const { return data_[i]; }
+		T &operator[](size_t i) { assert(!attached_); return store_[i]; }
+
+		// Owned storage
+		void clear() { store_.clear(); attached_ = false; sync(); }
+		void push_back(const T &value) { own(); store_.push_back(value); sync(); }
+		void resize(size_t n) { own(); store_.resize(n); sync(); }
+		void assign(size_t n, const T &value) { own(); store_.assign(n, value); sync(); }
+
+		// External storage of n values at data
+		void attach(const T *data, size_t n)
+		{
+			store_ = vector<T>();
+			attached_ = true;
+			data_ = data;
+			size_ = n;
+		}
+
+	private:
+		void own()
+		{
+			if (attached_)
+			{
+				store_.assign(data_, data_ + size_);
+				attached_ = false;
+			}
+		}
+		void sync() { data_ = store_.data(); size_ = store_.size(); }
+
+		vector<T> store_;
+		const T *data_ = nullptr;
+		size_t size_ = 0;
+		bool attached_ = false;
+	};
+
+} // namespace carnd
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "planner.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Writer of the control messages sent to the simulator, straight into a
+	// buffer reused over the messages
+	class ControlSerializer
+	{
+	public:
+		// Decimals of the path points, up to 9. Negative for the shortest
+		// text reading back to the same double.
+		int decimals = -1;
+
+		// 42["control",{"next_x":[...],"next_y":[...]}] message of the path,
+		// valid until the next call
+		const string &write(const path_t &path);
+
+	private:
+		// Longest number written, with its separator
+		static const size_t max_number = 32;
+
+		char *numbers(char *p, const vector<double> &values) const;
+		char *number(char *p, double value) const;
+		char *shortest(char *p, double value) const;
+		char *fixed(char *p, double value) const;
+		// units / 10^n_decimals in plain decimal notation
+		static char *decimal(char *p, bool negative, uint64_t units, int n_decimals);
+
+		string buffer_;
+	};
+
+	const string &ControlSerializer::write(const path_t &path)
+	{
+		static const char head[] = "42[\"control\",{\"next_x\":[";
+		static const char middle[] = "],\"next_y\":[";
+		static const char tail[] = "]}]";
+
+		// Capacity kept over the messages, only the first ones allocate
+		buffer_.resize(sizeof(head) + sizeof(middle) + sizeof(tail) + (path.x.size() + path.y.size()) * max_number);
+		char *begin = &buffer_[0];
+		char *p = begin;
+		memcpy(p, head, sizeof(head) - 1);
+		p = numbers(p + sizeof(head) - 1, path.x);
+		memcpy(p, middle, sizeof(middle) - 1);
+		p = numbers(p + sizeof(middle) - 1, path.y);
+		memcpy(p, tail, sizeof(tail) - 1);
+		p += sizeof(tail) - 1;
+		buffer_.resize(p - begin);
+		return buffer_;
+	}
+
+	char *ControlSerializer::numbers(char *p, const vector<double> &values) const
+	{
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			if (i > 0)
+				*p++ = ',';
+			p = number(p, values[i]);
+		}
+		return p;
+	}
+
+	char *ControlSerializer::number(char *p, double value) const
+	{
+		// No json text for them, written as null like the json library
+		if (!isfinite(value))
+		{
+			memcpy(p, "null", 4);
+			return p + 4;
+		}
+		return decimals >= 0 ? fixed(p, value) : shortest(p, value);
+	}
+
+	char *ControlSerializer::shortest(char *p, double value) const
+	{
+#if LDBL_MANT_DIG == 64
+		// Fewest decimals reading back to the value, for the plain decimal
+		// numbers. The decimals are exact in the x87 extended precision,
+		// whose single rounding gives the double unless it lands next to a
+		// half way point between two doubles, left to strtod.
+		static const long double powers[] = {
+			1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L,
+			1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L };
+		const double magnitude = fabs(value);
+		if (magnitude >= 1e-3 && magnitude < 1e15)
+		{
+			// 17 significant digits always read back the same
+			int integer_digits = -2;
+			while (magnitude >= powers[integer_digits + 3] * 1e-3L)
+				integer_digits++;
+			const int max_decimals = 17 - integer_digits;
+
+			auto reads_back = [&](int n, uint64_t &units)
+			{
+				const long double scaled = (long double)magnitude * powers[n];
+				units = (uint64_t)(scaled + 0.5L);
+				const long double text = units / powers[n];
+				// Explicit 64 bit significand in the low bytes
+				uint64_t bits;
+				memcpy(&bits, &text, sizeof(bits));
+				bits &= 0x7ff;
+				if (bits < 0x3ff || bits > 0x401)
+					return (double)text == magnitude;
+				// Rounded by strtod next to a half way point
+				*decimal(p, false, units, n) = 0;
+				return strtod(p, nullptr) == magnitude;
+			};
+
+			// Reading back holds from some number of decimals on
+			uint64_t units;
+			int low = 0, high = max_decimals;
+			while (low < high)
+			{
+				const int n = (low + high) / 2;
+				if (reads_back(n, units))
+					high = n;
+				else
+					low = n + 1;
+			}
+			if (reads_back(low, units))
+				return decimal(p, value < 0, units, low);
+		}
+#endif
+
+		// Significant digits with the C library otherwise, 17 are enough
+		for (int digits = 15; digits < 17; digits++)
+		{
+			const int n = snprintf(p, max_number, "%.*g", digits, value);
+			if (strtod(p, nullptr) == value)
+				return p + n;
+		}
+		return p + snprintf(p, max_number, "%.17g", value);
+	}
+
+	char *ControlSerializer::fixed(char *p, double value) const
+	{
+		static const double scales[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+		assert(decimals <= 9);
+		const int n_decimals = decimals;
+		const double scaled = fabs(value) * scales[n_decimals];
+		// Beyond the exact integers of a double
+		if (scaled >= 9e15)
+			return shortest(p, value);
+		return decimal(p, value < 0, (uint64_t)(scaled + 0.5), n_decimals);
+	}
+
+	char *ControlSerializer::decimal(char *p, bool negative, uint64_t units, int n_decimals)
+	{
+		if (negative && units > 0)
+			*p++ = '-';
+
+		// Digits from the last one, trailing zero decimals are left out
+		char digits[24];
+		int n = 0;
+		for (; n_decimals > 0 && units % 10 == 0; n_decimals--)
+			units /= 10;
+		for (int k = 0; k < n_decimals; k++, units /= 10)
+			digits[n++] = '0' + units % 10;
+		if (n_decimals > 0)
+			digits[n++] = '.';
+		do
+		{
+			digits[n++] = '0' + units % 10;
+			units /= 10;
+		} while (units > 0);
+
+		while (n > 0)
+			*p++ = digits[--n];
+		return p;
+	}
+
+} // namespace carnd
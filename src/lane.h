@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <cmath>
 #include <random>
+#include "logger.h"
 
 
 namespace carnd
@@ -60,11 +61,11 @@ namespace carnd
 	int Lane::lane_at(double d) const
 	{
 		if (d < 0){
-			cout << "ERROR: car beyond the left lane !!!" << endl;
+			LOG_ERROR("ERROR: car beyond the left lane !!!");
 			return -1; 
 		}
 		else if (d > road_width){
-			cout << "ERROR: car beyond the right lane !!!" << endl;
+			LOG_ERROR("ERROR: car beyond the right lane !!!");
 			return -2;
 		}
 		return floor(d / lane_width);
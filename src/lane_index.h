@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Cars of each lane sorted by s for the nearest car ahead or behind a
+	// position. The order of the previous update is repaired with an
+	// insertion sort, since it barely changes between ticks.
+	struct lane_index
+	{
+		struct lane_t
+		{
+			vector<double> s;
+			vector<int> car; // index in the cars of the update
+			vector<int> id;  // car id, to follow the cars between updates
+		};
+
+		vector<lane_t> lanes;
+		vector<char> indexed; // cars already placed in a lane
+		double max_s = 0;
+
+		// Update with the s, id and lane of n cars, the cars in lanes out of
+		// [0, lane_count) are left out
+		void update(const double *s, const int *id, const int *lane, size_t n,
+					int lane_count, double max_s_);
+
+		// Nearest car strictly ahead of s in the lane, within half the road
+		// loop, -1 if none, with its positive gap
+		int ahead(int lane, double s, double &gap) const;
+
+		// Nearest car at or behind s in the lane, within half the road loop,
+		// -1 if none, with its negative gap
+		int behind(int lane, double s, double &gap) const;
+
+	private:
+		static void sort_lane(lane_t &l);
+	};
+
+	void lane_index::update(const double *s, const int *id, const int *lane, size_t n,
+							int lane_count, double max_s_)
+	{
+		max_s = max_s_;
+		lanes.resize(lane_count);
+		indexed.assign(n, 0);
+
+		// Keep the cars still in their lane in the previous order
+		for (int L = 0; L < lane_count; L++)
+		{
+			lane_t &l = lanes[L];
+			size_t k = 0;
+			for (size_t j = 0; j < l.car.size(); j++)
+			{
+				const int c = l.car[j];
+				if (c < (int)n && id[c] == l.id[j] && lane[c] == L && !indexed[c])
+				{
+					l.s[k] = s[c];
+					l.car[k] = c;
+					l.id[k] = id[c];
+					indexed[c] = 1;
+					k++;
+				}
+			}
+			l.s.resize(k);
+			l.car.resize(k);
+			l.id.resize(k);
+		}
+
+		// Add the new cars of each lane
+		for (size_t c = 0; c < n; c++)
+		{
+			if (indexed[c] || lane[c] < 0 || lane[c] >= lane_count)
+				continue;
+			lane_t &l = lanes[lane[c]];
+			l.s.push_back(s[c]);
+			l.car.push_back(c);
+			l.id.push_back(id[c]);
+		}
+
+		for (auto &l : lanes)
+			sort_lane(l);
+	}
+
+	void lane_index::sort_lane(lane_t &l)
+	{
+		for (size_t i = 1; i < l.s.size(); i++)
+		{
+			const double s = l.s[i];
+			const int car = l.car[i];
+			const int id = l.id[i];
+			size_t j = i;
+			for (; j > 0 && l.s[j - 1] > s; j--)
+			{
+				l.s[j] = l.s[j - 1];
+				l.car[j] = l.car[j - 1];
+				l.id[j] = l.id[j - 1];
+			}
+			l.s[j] = s;
+			l.car[j] = car;
+			l.id[j] = id;
+		}
+	}
+
+	int lane_index::ahead(int lane, double s, double &gap) const
+	{
+		const lane_t &l = lanes[lane];
+		if (l.s.empty())
+			return -1;
+
+		// First car after s, wrapping to the first of the lane
+		size_t k = upper_bound(l.s.begin(), l.s.end(), s) - l.s.begin();
+		if (k == l.s.size())
+			k = 0;
+
+		double g = l.s[k] - s;
+		if (g <= 0)
+			g += max_s;
+		if (g > 0.5 * max_s)
+			return -1;
+
+		gap = g;
+		return l.car[k];
+	}
+
+	int lane_index::behind(int lane, double s, double &gap) const
+	{
+		const lane_t &l = lanes[lane];
+		if (l.s.empty())
+			return -1;
+
+		// Last car at or before s, wrapping to the last of the lane
+		size_t k = upper_bound(l.s.begin(), l.s.end(), s) - l.s.begin();
+		if (k == 0)
+			k = l.s.size();
+		k--;
+
+		double g = l.s[k] - s;
+		if (g > 0)
+			g -= max_s;
+		if (g < -0.5 * max_s)
+			return -1;
+
+		gap = g;
+		return l.car[k];
+	}
+
+} // namespace carnd
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+
+// Compile time log level, the records below it are removed by the compiler:
+// 0 trace, 1 debug, 2 info, 3 warn, 4 error, 5 off
+#ifndef CARND_LOG_LEVEL
+#define CARND_LOG_LEVEL 1
+#endif
+
+// Log a printf like format with its arguments, the arguments are only
+// evaluated when the level is enabled. The format must outlive the record,
+// as literals do, because it is formatted later. String arguments are
+// copied into the record, up to log_record_t::max_text bytes in all.
+#define CARND_LOG(level, ...) \
+	do { \
+		if ((level) >= CARND_LOG_LEVEL && carnd::logger().enabled(level)) \
+			carnd::logger().log((level), __VA_ARGS__); \
+	} while (0)
+
+#define LOG_TRACE(...) CARND_LOG(carnd::LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) CARND_LOG(carnd::LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) CARND_LOG(carnd::LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) CARND_LOG(carnd::LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) CARND_LOG(carnd::LEVEL_ERROR, __VA_ARGS__)
+
+
+namespace carnd
+{
+	using namespace std;
+
+	enum LOG_LEVEL
+	{
+		LEVEL_TRACE = 0,
+		LEVEL_DEBUG = 1,
+		LEVEL_INFO = 2,
+		LEVEL_WARN = 3,
+		LEVEL_ERROR = 4,
+		LEVEL_OFF = 5
+	};
+
+	// Log record, the format and its arguments in binary. The strings are
+	// copied in text, their argument is their offset in it.
+	struct log_record_t
+	{
+		static const int max_args = 8;
+		static const int max_text = 128;
+
+		const char *format;
+		int level;
+		int n_args;
+		char types[max_args]; // 'i' integer, 'f' floating point, 's' string
+		union
+		{
+			long long i;
+			double f;
+		} args[max_args];
+		int text_length;
+		char text[max_text];
+	};
+
+	// Lock free ring of records for several producers and a single consumer.
+	// A producer claims a slot by moving the head with a CAS, and publishes
+	// it through the slot sequence, so the consumer only reads the records
+	// whose writing is complete, in the order of the claims.
+	template <size_t N>
+	class log_ring
+	{
+		static_assert((N & (N - 1)) == 0, "log ring size must be a power of 2");
+
+	public:
+		log_ring()
+		{
+			for (size_t i = 0; i < N; i++)
+				sequences_[i].store(i, memory_order_relaxed);
+		}
+
+		// Slot for the next record and its ticket, nullptr if the ring is full
+		log_record_t *reserve(size_t &ticket)
+		{
+			size_t head = head_.load(memory_order_relaxed);
+			while (true)
+			{
+				const size_t sequence = sequences_[head & (N - 1)].load(memory_order_acquire);
+				// The slot is still holding the record of the previous lap
+				if (sequence != head)
+				{
+					if ((ptrdiff_t)(sequence - head) < 0)
+						return nullptr;
+					head = head_.load(memory_order_relaxed);
+				}
+				else if (head_.compare_exchange_weak(head, head + 1, memory_order_relaxed))
+				{
+					ticket = head;
+					return &records_[head & (N - 1)];
+				}
+			}
+		}
+		// Publish the record of the ticket
+		void commit(size_t ticket) { sequences_[ticket & (N - 1)].store(ticket + 1, memory_order_release); }
+
+		// Oldest record, nullptr if the ring is empty or it is not published yet
+		const log_record_t *front() const
+		{
+			const size_t tail = tail_.load(memory_order_relaxed);
+			if (sequences_[tail & (N - 1)].load(memory_order_acquire) != tail + 1)
+				return nullptr;
+			return &records_[tail & (N - 1)];
+		}
+		// Release the oldest record, its slot is free for the next lap
+		void pop()
+		{
+			const size_t tail = tail_.load(memory_order_relaxed);
+			sequences_[tail & (N - 1)].store(tail + N, memory_order_release);
+			tail_.store(tail + 1, memory_order_release);
+		}
+
+		// Records claimed and popped so far
+		size_t pushed() const { return head_.load(memory_order_acquire); }
+		size_t popped() const { return tail_.load(memory_order_acquire); }
+
+	private:
+		alignas(64) atomic<size_t> head_{0};
+		alignas(64) atomic<size_t> tail_{0};
+		alignas(64) array<atomic<size_t>, N> sequences_;
+		array<log_record_t, N> records_;
+	};
+
+	// Asynchronous logger, any thread pushes binary records that a background
+	// thread formats and writes. The records of one thread are written in
+	// order, the ones of different threads in the order they got their slot.
+	class Logger
+	{
+	public:
+		Logger();
+		Logger(const Logger &) = delete;
+		Logger &operator=(const Logger &) = delete;
+		~Logger();
+
+		// Runtime log level, at or above CARND_LOG_LEVEL to have any effect
+		void set_level(int level_) { level.store(level_, memory_order_relaxed); }
+		bool enabled(int level_) const { return level_ >= level.load(memory_order_relaxed); }
+
+		// Output of the rendered records, set before logging
+		void set_output(FILE *output_) { output = output_; }
+
+		// Push a record from any thread, dropped if the ring is full
+		template <typename... Args>
+		void log(int level_, const char *format, Args... args);
+
+		// Wait until all the records pushed so far are written
+		void flush();
+
+		// Records dropped because the ring was full
+		size_t dropped() const { return dropped_.load(memory_order_relaxed); }
+
+	private:
+		static void pack(log_record_t &) {}
+		template <typename T, typename... Args>
+		static void pack(log_record_t &record, T value, Args... args);
+
+		template <typename T>
+		static typename enable_if<is_integral<T>::value || is_enum<T>::value>::type
+		set_arg(log_record_t &record, T value) { record.types[record.n_args] = 'i'; record.args[record.n_args].i = (long long)value; }
+		template <typename T>
+		static typename enable_if<is_floating_point<T>::value>::type
+		set_arg(log_record_t &record, T value) { record.types[record.n_args] = 'f'; record.args[record.n_args].f = value; }
+		static void set_arg(log_record_t &record, const char *value);
+
+		// Background thread writing the records
+		void run();
+		// Format a record in the line buffer, returns its length
+		size_t render(const log_record_t &record);
+
+		atomic<int> level{LEVEL_DEBUG};
+		FILE *output = stdout;
+		log_ring<4096> ring_;
+		atomic<size_t> dropped_{0};
+		atomic<size_t> written_{0};
+		atomic<bool> stop_{false};
+		char line_[1024];
+		thread thread_;
+	};
+
+	Logger::Logger()
+	{
+		thread_ = thread(&Logger::run, this);
+	}
+
+	Logger::~Logger()
+	{
+		stop_ = true;
+		thread_.join();
+		if (dropped() > 0)
+			fprintf(output, "WARNING: %zu log records dropped !!!\n", dropped());
+	}
+
+	template <typename... Args>
+	void Logger::log(int level_, const char *format, Args... args)
+	{
+		size_t ticket;
+		log_record_t *record = ring_.reserve(ticket);
+		if (!record)
+		{
+			dropped_.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+		record->format = format;
+		record->level = level_;
+		record->n_args = 0;
+		record->text_length = 0;
+		pack(*record, args...);
+		ring_.commit(ticket);
+	}
+
+	template <typename T, typename... Args>
+	void Logger::pack(log_record_t &record, T value, Args... args)
+	{
+		if (record.n_args < log_record_t::max_args)
+		{
+			set_arg(record, value);
+			record.n_args++;
+		}
+		pack(record, args...);
+	}
+
+	// Copy of the string, truncated to the room left in the record
+	void Logger::set_arg(log_record_t &record, const char *value)
+	{
+		if (!value)
+			value = "(null)";
+		const size_t room = log_record_t::max_text - 1 - record.text_length;
+		const size_t length = strnlen(value, room);
+		char *text = record.text + record.text_length;
+		memcpy(text, value, length);
+		text[length] = 0;
+		record.types[record.n_args] = 's';
+		record.args[record.n_args].i = record.text_length;
+		record.text_length += length + (length < room);
+	}
+
+	void Logger::flush()
+	{
+		const size_t pushed = ring_.pushed();
+		while (written_.load(memory_order_acquire) < pushed)
+			this_thread::sleep_for(chrono::microseconds(100));
+	}
+
+	void Logger::run()
+	{
+		while (true)
+		{
+			// Check before draining so that the records pushed before stop are written
+			const bool stop = stop_.load();
+
+			const log_record_t *record;
+			size_t n = 0;
+			while ((record = ring_.front()) != nullptr)
+			{
+				const size_t length = render(*record);
+				ring_.pop();
+				fwrite(line_, 1, length, output);
+				n++;
+			}
+
+			if (n > 0)
+			{
+				fflush(output);
+				written_.store(ring_.popped(), memory_order_release);
+			}
+			else if (stop)
+				break;
+			else
+				this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	}
+
+	size_t Logger::render(const log_record_t &r)
+	{
+		const size_t size = sizeof(line_) - 1;
+		size_t length = 0;
+		int arg = 0;
+
+		const char *p = r.format;
+		while (*p && length < size)
+		{
+			if (*p != '%')
+			{
+				line_[length++] = *p++;
+				continue;
+			}
+			if (p[1] == '%')
+			{
+				line_[length++] = '%';
+				p += 2;
+				continue;
+			}
+
+			// Conversion flags, width and precision, the length modifiers
+			// are replaced to match the stored argument. A * width or
+			// precision takes the next integer argument.
+			char spec[48];
+			int n = 0;
+			bool valid = true;
+			spec[n++] = *p++;
+			while (*p && strchr("-+ #0123456789.*", *p) && n < 32)
+			{
+				if (*p != '*')
+				{
+					spec[n++] = *p++;
+					continue;
+				}
+				p++;
+				valid = valid && arg < r.n_args && r.types[arg] == 'i';
+				if (valid)
+				{
+					const int value = (int)max(-999LL, min(999LL, r.args[arg].i));
+					// A negative precision is none
+					if (value < 0 && spec[n - 1] == '.')
+						n--;
+					else
+						n += snprintf(spec + n, 12, "%d", value);
+				}
+				arg++;
+			}
+			while (*p && strchr("hlLjzt", *p))
+				p++;
+			const char conversion = *p ? *p++ : 's';
+			if (arg >= r.n_args)
+				continue;
+			if (!valid)
+			{
+				// Not an integer for the *, the argument is skipped
+				static const char invalid[] = "(invalid *)";
+				const size_t room = min(sizeof(invalid) - 1, size - length);
+				memcpy(line_ + length, invalid, room);
+				length += room;
+				arg++;
+				continue;
+			}
+
+			const bool floating = strchr("fFeEgGaA", conversion) != nullptr;
+			int written = 0;
+			switch (r.types[arg])
+			{
+			case 'i':
+				if (floating)
+				{
+					spec[n++] = conversion;
+					spec[n] = 0;
+					written = snprintf(line_ + length, size + 1 - length, spec, (double)r.args[arg].i);
+				}
+				else if (conversion == 'c')
+				{
+					spec[n++] = 'c';
+					spec[n] = 0;
+					written = snprintf(line_ + length, size + 1 - length, spec, (int)r.args[arg].i);
+				}
+				else
+				{
+					spec[n++] = 'l';
+					spec[n++] = 'l';
+					spec[n++] = strchr("diouxX", conversion) ? conversion : 'd';
+					spec[n] = 0;
+					written = snprintf(line_ + length, size + 1 - length, spec, r.args[arg].i);
+				}
+				break;
+			case 'f':
+				spec[n++] = floating ? conversion : 'g';
+				spec[n] = 0;
+				written = snprintf(line_ + length, size + 1 - length, spec, r.args[arg].f);
+				break;
+			default:
+				spec[n++] = 's';
+				spec[n] = 0;
+				written = snprintf(line_ + length, size + 1 - length, spec, r.text + r.args[arg].i);
+				break;
+			}
+			length = min(size, length + (size_t)max(written, 0));
+			arg++;
+		}
+
+		line_[length++] = '\n';
+		return length;
+	}
+
+	// Process wide logger
+	Logger &logger()
+	{
+		static Logger instance;
+		return instance;
+	}
+
+} // namespace carnd
@@ -1,112 +1,125 @@
 #include <fstream>
+#include <csignal>
 #include <math.h>
 #include <uWS/uWS.h>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
 #include "Eigen-3.3/Eigen/QR"
-#include "json.hpp"
 #include "planner.h"
+#include "telemetry.h"
+#include "control.h"
 
 using namespace std;
 
-// for convenience
-using json = nlohmann::json;
-
-namespace carnd {
-  // Read data from json
-  void from_json(const json & j, car_t & car) {
-
-    car.id = j[0].get<int>();
-    car.x = j[1];
-    car.y = j[2];
-    car.vx = j[3];
-    car.vy = j[4];
-    car.s = j[5];
-    car.d = j[6];
-  }
-
-  void from_json(const json & j, ego_t & ego) {
-    // Main car's localization Data
-    ego.x = j["x"];
-    ego.y = j["y"];
-    ego.s = j["s"];
-    ego.d = j["d"];
-    ego.yaw = deg2rad(j["yaw"]);
-    ego.v = mph2mps(j["speed"]);
-    // Previous path data given to the Planner
-    ego.previous_path.x = j["previous_path_x"].get<vector<double>>();
-    ego.previous_path.y = j["previous_path_y"].get<vector<double>>();
-    // Previous path's end s and d values 
-    ego.end_path.s = j["end_path_s"];
-    ego.end_path.d = j["end_path_d"];
-    // Sensor Fusion Data, a list of all other cars on the same side of the road.
-    ego.cars = j["sensor_fusion"].get<vector<car_t>>();
-  }
-}
-
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.find_first_of("}");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
-  }
-  return "";
-}
-
-
-int main() {
+int main(int argc, char *argv[]) {
   uWS::Hub h;
 
   // Path planner
   carnd::PathPlanner planner;
-  // Waypoint map to read from
+  // Waypoint map to read from, the csv map unless another one is given
+  // with "map=../data/highway_map.bin" for instance, such as a binary map
+  // made by map_converter
   string map_file_ = "../data/highway_map.csv";
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "map=", 4) == 0) {
+      map_file_ = argv[i] + 4;
+    }
+  }
 
-  planner.initialize(map_file_);
+  if (!planner.initialize(map_file_)) {
+    std::cerr << "Failed to load the map " << map_file_ << std::endl;
+    return -1;
+  }
+  LOG_INFO("Map %s loaded", map_file_.c_str());
+  // Trajectory engine, "quintic" for the jerk minimal candidates, or
+  // "search" for the search over all lanes, speeds and horizons
+  if (argc > 1 && string(argv[1]) == "quintic") {
+    planner.set_engine(carnd::PathPlanner::ENGINE::QUINTIC);
+  }
+  else if (argc > 1 && string(argv[1]) == "search") {
+    planner.set_planning(carnd::PathPlanner::PLANNING::SEARCH);
+  }
 
 
-  h.onMessage([&planner](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+  // Stage latencies are dumped on SIGUSR1, at disconnection and at exit
+  carnd::profiler().exit_output = stderr;
+  signal(SIGUSR1, [](int) { carnd::profiler().dump_requested = true; });
+
+  // Telemetry and next path, kept between the messages to reuse their buffers
+  carnd::ego_t ego;
+  carnd::path_t next_path;
+  carnd::TelemetryParser parser;
+  carnd::ControlSerializer serializer;
+  ego.previous_path.x.reserve(planner.n_path_points);
+  ego.previous_path.y.reserve(planner.n_path_points);
+  ego.cars.reserve(32);
+  next_path.x.reserve(planner.n_path_points);
+  next_path.y.reserve(planner.n_path_points);
+  // Path points sent with a fixed number of decimals with "decimals=3" for
+  // instance, fewer bytes than the shortest exact numbers sent by default.
+  // -1 is the default.
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "decimals=", 9) == 0) {
+      char *end;
+      const long decimals = strtol(argv[i] + 9, &end, 10);
+      if (end == argv[i] + 9 || *end || decimals < -1 || decimals > 9) {
+        std::cerr << "Invalid " << argv[i] << ", decimals are from -1 to 9" << std::endl;
+        return -1;
+      }
+      serializer.decimals = decimals;
+    }
+  }
+
+  h.onMessage([&planner, &ego, &next_path, &parser, &serializer](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
                      uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
-    //auto sdata = string(data).substr(0, length);
-    //cout << sdata << endl;
-    if (length && length > 2 && data[0] == '4' && data[1] == '2') {
-
-      auto s = hasData(data);
+    // The event and its payload are views into the message, no copy
+    carnd::frame_t frame;
+    if (carnd::decode_frame(data, length, frame)) {
 
-      if (s != "") {
-        auto j = json::parse(s);
-        
-        string event = j[0].get<string>();
+      if (frame.payload_length) {
         
-        if (event == "telemetry") {
-          
-          carnd::path_t next_path;
+        if (frame.is("telemetry")) {
+          // Telemetry read in one pass into the ego buffers
+          bool parsed;
+          {
+            PROFILE_SCOPE(carnd::STAGE_PARSE);
+            parsed = parser.parse(frame.payload, frame.payload + frame.payload_length, ego);
+          }
+          if (!parsed) {
+            // The payload is in the receive buffer, a bounded excerpt from
+            // the error is copied for the logger
+            const size_t offset = parser.error() ? parser.error() - frame.payload : 0;
+            char excerpt[33];
+            const size_t n = min(sizeof(excerpt) - 1, frame.payload_length - offset);
+            memcpy(excerpt, frame.payload + offset, n);
+            excerpt[n] = 0;
+            LOG_ERROR("Malformed telemetry at %d of %d: %s", (int)offset, (int)frame.payload_length, excerpt);
+            return;
+          }
           
           // run the planner to get x,y next path point
           // sample time is 0.02s
-          planner.run(j[1], next_path, 0.02);
+          planner.run(ego, next_path, 0.02);
           
-        	
-        	json msgJson;
-        	msgJson["next_x"] = next_path.x;
-        	msgJson["next_y"] = next_path.y;
-
-        	auto msg = "42[\"control\","+ msgJson.dump()+"]";
+        	// Written in the serializer buffer, no intermediate strings
+        	const string *msg;
+        	{
+        	  PROFILE_SCOPE(carnd::STAGE_SERIALIZE);
+        	  msg = &serializer.write(next_path);
+        	}
 
         	//this_thread::sleep_for(chrono::milliseconds(1000));
-        	ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+        	ws.send(msg->data(), msg->length(), uWS::OpCode::TEXT);
+
+        	carnd::profiler().dump_if_requested(stderr);
           
         }
       } else {
@@ -139,6 +152,7 @@ int main() {
                          char *message, size_t length) {
     ws.close();
     std::cout << "Disconnected" << std::endl;
+    carnd::profiler().dump(stderr);
   });
 
   int port = 4567;
@@ -0,0 +1,34 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "roadmap.h"
+
+using namespace std;
+
+// Convert a csv waypoints map to a binary map file with the precomputed
+// tables, which the planner maps in place at startup.
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    cerr << "Usage: " << argv[0] << " <map.csv> <map.bin> [resolution]" << endl;
+    return -1;
+  }
+
+  carnd::RoadMap roadmap;
+  // Optional resolution of the spline map samples (m)
+  if (argc > 3) {
+    roadmap.resolution = atof(argv[3]);
+  }
+  if (!roadmap.load(argv[1]) || roadmap.waypoints.size() < 2) {
+    cerr << "Failed to read waypoints from " << argv[1] << endl;
+    return -1;
+  }
+
+  if (!roadmap.save(argv[2])) {
+    cerr << "Failed to write " << argv[2] << endl;
+    return -1;
+  }
+
+  cout << "Wrote " << roadmap.waypoints.size() << " waypoints to " << argv[2] << endl;
+  return 0;
+}
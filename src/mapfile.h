@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Binary map file: a header followed by the arrays of the map, each one
+	// aligned to map_alignment bytes so they can be used in place once the
+	// file is memory mapped.
+	constexpr char MAP_MAGIC[8] = {'C', 'A', 'R', 'N', 'D', 'M', 'A', 'P'};
+	constexpr uint32_t MAP_VERSION = 2;
+	constexpr uint32_t MAP_ENDIAN = 0x01020304;
+	constexpr size_t map_alignment = 64;
+
+	// Arrays stored in a map file
+	enum MAP_SECTION
+	{
+		WAYPOINT_X, WAYPOINT_Y, WAYPOINT_S, WAYPOINT_DX, WAYPOINT_DY, WAYPOINT_PACKED,
+		GRID_START, GRID_ITEMS,
+		SEGMENT_S, SEGMENT_X, SEGMENT_Y, SEGMENT_TX, SEGMENT_TY, SEGMENT_NX, SEGMENT_NY,
+		SEGMENT_PACKED, SEGMENT_BUCKET, SEGMENT_BUCKET_NEXT,
+		SAMPLE_X, SAMPLE_Y, SAMPLE_NX, SAMPLE_NY,
+		MAP_SECTIONS
+	};
+
+	// Location of an array in a map file
+	struct map_section_t
+	{
+		uint64_t offset; // bytes from the start of the file
+		uint64_t count;  // number of elements
+	};
+
+	// Map file header
+	struct map_header_t
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t endian;
+		uint32_t sections;
+		uint32_t reserved;
+
+		double max_s;
+		// waypoint grid
+		double grid_x0, grid_y0, grid_cell;
+		int32_t grid_nx, grid_ny;
+		// segments
+		double bucket_scale;
+		// spline map samples, resolution 0 if not sampled
+		double resolution;
+		double sample_step;
+
+		map_section_t section[MAP_SECTIONS];
+	};
+
+	// Read only memory mapping of a whole file
+	struct mapped_file
+	{
+		const char *data = nullptr;
+		size_t size = 0;
+
+		mapped_file() {}
+		mapped_file(const mapped_file &) = delete;
+		mapped_file &operator=(const mapped_file &) = delete;
+		~mapped_file() { close(); }
+
+		// Map the file, returns false on error
+		bool open(const string &filename);
+		void close();
+	};
+
+	bool mapped_file::open(const string &filename)
+	{
+		close();
+
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED)
+			{
+				data = (const char *)p;
+				size = st.st_size;
+			}
+		}
+		::close(fd);
+
+		return data != nullptr;
+	}
+
+	void mapped_file::close()
+	{
+		if (data)
+			munmap((void *)data, size);
+		data = nullptr;
+		size = 0;
+	}
+
+	// Check if a file starts with the map file magic
+	bool is_map_file(const string &filename)
+	{
+		char magic[sizeof(MAP_MAGIC)] = {0};
+		FILE *f = fopen(filename.c_str(), "rb");
+		if (!f)
+			return false;
+		const bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+						&& memcmp(magic, MAP_MAGIC, sizeof(MAP_MAGIC)) == 0;
+		fclose(f);
+		return ok;
+	}
+
+} // namespace carnd
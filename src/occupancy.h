@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "predictor.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Occupancy of the road by the predicted cars over lanes, s bins and
+	// the time steps of the rollouts, one bit per bin. The s bins wrap
+	// around at the end of the road loop.
+	class occupancy_grid
+	{
+	public:
+		double bin = 2.0;        // m, length of an s bin
+		double car_length = 5.0; // m, footprint of a car
+		double car_width = 2.0;  // m
+
+		// Clear the grid for lane_count lanes and the steps of a rollout
+		void clear(int lane_count, int n_steps, double step, double max_s);
+
+		// Mark the footprints of the cars in the rollouts of a model, the
+		// cars with a negative lane are left out
+		void fill(const Predictor &prediction, int model, const int *cars_lane, double lane_width);
+
+		// Mark [s0, s1] of a lane at a step
+		void mark(int lane, int k, double s0, double s1);
+
+		// No car in [s0, s1] of the lane at any step over [t0, t1]
+		bool is_free(int lane, double s0, double s1, double t0, double t1) const;
+
+	private:
+		uint64_t *row(int lane, int k) { return &bits_[((size_t)lane * steps_ + k) * words_]; }
+		const uint64_t *row(int lane, int k) const { return &bits_[((size_t)lane * steps_ + k) * words_]; }
+
+		// Bin ranges of [s0, s1], two when it wraps around, returns their number
+		int ranges(double s0, double s1, int first[2], int last[2]) const;
+
+		static uint64_t mask(int first, int last) { return (~0ull << first) & (~0ull >> (63 - last)); }
+
+		vector<uint64_t> bits_;
+		int lanes_ = 0;
+		int steps_ = 0;
+		int words_ = 0;
+		int n_bins_ = 0;
+		double step_ = 1;
+		double max_s_ = 0;
+		double inv_bin_ = 0.5;
+	};
+
+	void occupancy_grid::clear(int lane_count, int n_steps, double step, double max_s)
+	{
+		lanes_ = lane_count;
+		steps_ = n_steps + 1;
+		step_ = step;
+		max_s_ = max_s;
+		inv_bin_ = 1 / bin;
+		n_bins_ = (int)ceil(max_s * inv_bin_);
+		words_ = (n_bins_ + 63) / 64;
+		bits_.assign((size_t)lanes_ * steps_ * words_, 0);
+	}
+
+	void occupancy_grid::fill(const Predictor &prediction, int model, const int *cars_lane, double lane_width)
+	{
+		const double half_length = 0.5 * car_length;
+		const double half_width = 0.5 * car_width;
+		for (int k = 0; k < steps_; k++)
+		{
+			const float *s = prediction.s_row(model, k);
+			const float *d = prediction.d_row(model, k);
+			for (size_t i = 0; i < prediction.size(); i++)
+			{
+				if (cars_lane[i] < 0)
+					continue;
+				// Every lane the car body overlaps, twice while changing lanes
+				const int left = max(0, (int)floor((d[i] - half_width) / lane_width));
+				const int right = min(lanes_ - 1, (int)floor((d[i] + half_width) / lane_width));
+				for (int lane = left; lane <= right; lane++)
+					mark(lane, k, s[i] - half_length, s[i] + half_length);
+			}
+		}
+	}
+
+	int occupancy_grid::ranges(double s0, double s1, int first[2], int last[2]) const
+	{
+		if (s1 - s0 >= max_s_)
+		{
+			first[0] = 0;
+			last[0] = n_bins_ - 1;
+			return 1;
+		}
+
+		// The positions are rarely more than a lap away
+		const double length = max(s1 - s0, 0.0);
+		if (s0 < 0 || s0 >= max_s_)
+			s0 -= floor(s0 / max_s_) * max_s_;
+		s1 = s0 + length;
+
+		first[0] = min((int)(s0 * inv_bin_), n_bins_ - 1);
+		if (s1 < max_s_)
+		{
+			last[0] = min((int)(s1 * inv_bin_), n_bins_ - 1);
+			return 1;
+		}
+		last[0] = n_bins_ - 1;
+		first[1] = 0;
+		last[1] = min((int)((s1 - max_s_) * inv_bin_), n_bins_ - 1);
+		return 2;
+	}
+
+	void occupancy_grid::mark(int lane, int k, double s0, double s1)
+	{
+		uint64_t *bits = row(lane, k);
+		int first[2], last[2];
+		const int n = ranges(s0, s1, first, last);
+		for (int r = 0; r < n; r++)
+		{
+			const int w0 = first[r] >> 6, w1 = last[r] >> 6;
+			if (w0 == w1)
+			{
+				bits[w0] |= mask(first[r] & 63, last[r] & 63);
+				continue;
+			}
+			bits[w0] |= mask(first[r] & 63, 63);
+			for (int w = w0 + 1; w < w1; w++)
+				bits[w] = ~0ull;
+			bits[w1] |= mask(0, last[r] & 63);
+		}
+	}
+
+	bool occupancy_grid::is_free(int lane, double s0, double s1, double t0, double t1) const
+	{
+		if (lane < 0 || lane >= lanes_)
+			return false;
+
+		const int k0 = max(0, min((int)floor(t0 / step_), steps_ - 1));
+		const int k1 = max(k0, min((int)ceil(t1 / step_), steps_ - 1));
+
+		int first[2], last[2];
+		const int n = ranges(s0, s1, first, last);
+		for (int r = 0; r < n; r++)
+		{
+			const int w0 = first[r] >> 6, w1 = last[r] >> 6;
+			const uint64_t mask0 = mask(first[r] & 63, w0 == w1 ? last[r] & 63 : 63);
+			const uint64_t mask1 = mask(0, last[r] & 63);
+
+			// Union of the steps, then the bins of the range
+			uint64_t any = 0;
+			for (int k = k0; k <= k1; k++)
+			{
+				const uint64_t *bits = row(lane, k);
+				any |= bits[w0] & mask0;
+				if (w1 > w0)
+				{
+					for (int w = w0 + 1; w < w1; w++)
+						any |= bits[w];
+					any |= bits[w1] & mask1;
+				}
+			}
+			if (any)
+				return false;
+		}
+		return true;
+	}
+
+} // namespace carnd
@@ -12,6 +12,20 @@
 #include "roadmap.h"
 #include "lane.h"
 #include "utils.h"
+#include "arclength.h"
+#include "quintic.h"
+#include "search.h"
+#include "workers.h"
+#include "logger.h"
+#include "profiler.h"
+#include "lane_index.h"
+#include "tracker.h"
+#include "predictor.h"
+#include "occupancy.h"
+#include "collision.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 
 namespace carnd
@@ -25,6 +39,54 @@ namespace carnd
 		double x, y, vx, vy, s, d;
 	};
 
+	// Car objects from sensor fusion data in columns
+	struct cars_list
+	{
+		vector<int> id;
+		vector<double> x, y, vx, vy, s, d;
+
+		size_t size() const { return id.size(); }
+		car_t operator[](int i) const { return {id[i], x[i], y[i], vx[i], vy[i], s[i], d[i]}; }
+
+		void resize(size_t n);
+		void reserve(size_t n);
+		void clear() { resize(0); }
+		void push_back(const car_t & car);
+	};
+
+	void cars_list::resize(size_t n)
+	{
+		id.resize(n);
+		x.resize(n);
+		y.resize(n);
+		vx.resize(n);
+		vy.resize(n);
+		s.resize(n);
+		d.resize(n);
+	}
+
+	void cars_list::reserve(size_t n)
+	{
+		id.reserve(n);
+		x.reserve(n);
+		y.reserve(n);
+		vx.reserve(n);
+		vy.reserve(n);
+		s.reserve(n);
+		d.reserve(n);
+	}
+
+	void cars_list::push_back(const car_t & car)
+	{
+		id.push_back(car.id);
+		x.push_back(car.x);
+		y.push_back(car.y);
+		vx.push_back(car.vx);
+		vy.push_back(car.vy);
+		s.push_back(car.s);
+		d.push_back(car.d);
+	}
+
 	// Path trajectory points
 	struct path_t
 	{
@@ -50,7 +112,7 @@ namespace carnd
 		double x, y, s, d, yaw, v; // ego motion
 		path_t previous_path;
 		sd_t end_path;
-		vector<car_t> cars; // cars from sensor fusion
+		cars_list cars; // cars from sensor fusion
 	};
 
 	struct lane_info_t
@@ -75,6 +137,32 @@ namespace carnd
 		Lane lane;
 
 		vector<lane_info_t> lane_info;
+		// Speed, predicted s, gaps to the reference and lane of each car
+		vector<double> cars_speed, cars_next_s, cars_gap, cars_gap_next;
+		vector<int> cars_lane;
+		// Cars of each lane sorted by s
+		lane_index cars_index;
+		// Filtered cars over the ticks
+		Tracker tracker;
+		// Size of the last path, its consumed points time the ticks
+		int sent_points = 0;
+		// Rollouts of the cars, the lane analysis and the search use the
+		// prediction model
+		Predictor predictor;
+		int prediction_model = MODEL_LIKELY;
+		// Lanes occupied by the predicted cars over the rollouts
+		occupancy_grid occupancy;
+		// Check of the final path against the rollouts, a hit makes the next
+		// speed control brake as an emergency
+		CollisionChecker collision;
+		vector<double> path_theta, path_s, path_d;
+		map_cursor path_cursor;
+		bool path_collision = false;
+		// Filtered acceleration and d rate, and car ahead in the lane of each car
+		vector<double> cars_accel, cars_d_dot;
+		vector<int> cars_leader;
+		// Lanes sorted from the best one
+		vector<int> lanes_order;
 
 		double accel = 0.1; // m/s^2
 		double emergy_accel = 0.15; // m/s^2
@@ -113,22 +201,66 @@ namespace carnd
 		STATE state_ = STATE::START;
 		double state_s_;
 
+		// Trajectory samples in the reference coordinate
+		vector<double> samples_s, samples_x, samples_y;
+		// Arc length of the trajectory spline
+		arc_length_table<16> arc_length;
+
+		// Trajectory engine, the spline path or the jerk minimal quintic candidates
+		enum class ENGINE { SPLINE = 0, QUINTIC = 1 };
+		ENGINE engine = ENGINE::SPLINE;
+
+		// Quintic candidates grid, end speeds between the start and target speeds and horizons
+		QuinticGenerator quintic;
+		vector<double> quintic_speed_fractions = {0.1, 0.2, 0.4, 0.6, 0.8, 1.0};
+		vector<double> quintic_horizons = {1.0, 1.5, 2.0, 2.5, 3.0, 4.0}; // s
+		vector<double> quintic_speeds, samples_d;
+		// Frenet state at the end of the last quintic path
+		frenet_state_t quintic_end;
+		bool quintic_valid = false;
+
+		// Planning mode, the behavior state machine or the search over
+		// candidates for every lane, speed and horizon
+		enum class PLANNING { BEHAVIOR = 0, SEARCH = 1 };
+		PLANNING planning = PLANNING::BEHAVIOR;
+
+		// Candidates search, end speeds between the start speed and 0 for the
+		// negative fractions or the speed limit for the positive ones
+		TrajectorySearch search;
+		WorkerPool workers;
+		int n_workers = -1; // one per core if negative
+		vector<double> search_speed_fractions = {-0.4, -0.2, -0.1, 0, 0.1, 0.2, 0.4, 0.6, 0.8, 1.0};
+		vector<double> search_lanes_d;
+		vector<char> lane_feasible;
+		double search_safe_gap = 15; //m
+		double search_min_gap = 5; //m
+
 	public:
-		void initialize(const string & map_file_);
+		// Load the map and reserve the buffers, false if the map is invalid
+		bool initialize(const string & map_file_);
 
 		void reset();
 
+		// Select the trajectory engine
+		void set_engine(ENGINE engine_);
+
+		// Select the planning mode, the search runs on the quintic engine
+		void set_planning(PLANNING planning_);
+
 		// Run the planner with telemetry data to generate next trajectory
 		// dt is the simulator period
 		void run(const ego_t & ego, path_t & path, double dt);
 
 	protected:
 		void set_state(const ego_t & ego, STATE new_state);
-		int get_best_lane() const;
+		int get_best_lane();
 
 		void get_reference(const ego_t & ego, double dt);
 		void track_lap(const ego_t & ego);
 		void process_sensor_fusion(const ego_t & ego, double dt);
+		void analyze_cars(const cars_list & cars, double horizon);
+		size_t analyze_cars_kernel(const cars_list & cars, double horizon);
+		void predict_cars(const cars_list & cars);
 		void create_plan(const ego_t & ego, double dt);
 		void collision_avoidance();
 		void speed_control();
@@ -137,12 +269,45 @@ namespace carnd
 						  const double target_speed, 
 						  path_t & path, 
 						  double dt);
+		void create_quintic_trajectory(const ego_t & ego, 
+								  const int target_lane, 
+								  const double target_speed, 
+								  path_t & path, 
+								  double dt);
+		void search_trajectory(const ego_t & ego, path_t & path, double dt);
+		void start_quintic(const ego_t & ego);
+		void emit_quintic(const ego_t & ego, const candidate_t & best, path_t & path, double dt);
+		void check_trajectory(const ego_t & ego, const path_t & path, double dt);
 
 	};
 
-	void PathPlanner::initialize(const string & map_file_)
+	bool PathPlanner::initialize(const string & map_file_)
 	{
-		roadmap.load(map_file_);
+		if (!roadmap.load(map_file_))
+			return false;
+
+		// Reserve the per tick buffers so that a tick does not allocate
+		lane_info.reserve(lane.lane_count);
+		lanes_order.reserve(lane.lane_count);
+		cars_speed.reserve(64);
+		cars_next_s.reserve(64);
+		cars_gap.reserve(64);
+		cars_gap_next.reserve(64);
+		cars_lane.reserve(64);
+		cars_accel.reserve(64);
+		cars_d_dot.reserve(64);
+		cars_leader.reserve(64);
+		predictor.lane_width = lane.lane_width;
+		predictor.lane_count = lane.lane_count;
+		predictor.reserve(64);
+		samples_s.reserve(n_path_points);
+		samples_d.reserve(n_path_points);
+		samples_x.reserve(n_path_points);
+		samples_y.reserve(n_path_points);
+		path_theta.reserve(n_path_points);
+		path_s.reserve(n_path_points);
+		path_d.reserve(n_path_points);
+		return true;
 	}
 
 	void PathPlanner::reset()
@@ -156,6 +321,39 @@ namespace carnd
 		ego_passed_zero_s = false;
 		state_ = STATE::START;
 		state_s_ = 0;
+		quintic_valid = false;
+		sent_points = 0;
+		tracker.clear();
+		path_collision = false;
+		path_cursor.reset();
+	}
+
+	void PathPlanner::set_engine(ENGINE engine_)
+	{
+		engine = engine_;
+		quintic_valid = false;
+		// Quintic paths are mapped point by point to xy, which needs the
+		// smooth spline samples of the map
+		if (engine == ENGINE::QUINTIC && roadmap.resolution <= 0)
+			roadmap.set_resolution(0.5);
+	}
+
+	void PathPlanner::set_planning(PLANNING planning_)
+	{
+		planning = planning_;
+		if (planning == PLANNING::SEARCH)
+		{
+			set_engine(ENGINE::QUINTIC);
+			if (workers.size() == 1)
+				workers.start(n_workers);
+		}
+		else
+			workers.stop();
+
+		// Rollouts over the planned path, and the longest candidate after it
+		// for the search
+		predictor.n_steps = planning == PLANNING::SEARCH ? 50 : 10;
+		predictor.reserve(64);
 	}
 
 	void PathPlanner::set_state(const ego_t & ego, STATE new_state)
@@ -167,12 +365,13 @@ namespace carnd
 		}
 	}
 
-	int PathPlanner::get_best_lane() const
+	int PathPlanner::get_best_lane()
 	{
 		if (lane_info[target_lane].is_clear())
 			return target_lane;
 
-		vector<int> lanes(lane.lane_count);
+		vector<int> & lanes = lanes_order;
+		lanes.resize(lane.lane_count);
 		iota(lanes.begin(), lanes.end(), 0);
 
 		// Search for the best lane
@@ -220,26 +419,78 @@ namespace carnd
 	// Planner main function, run the planner with telemetry data to generate next trajectory
 	void PathPlanner::run(const ego_t & ego, path_t & path, double dt)
 	{
+		PROFILE_SCOPE(STAGE_TICK);
+
 		// 1a. Get reference point of ego motion
-		get_reference(ego, dt);
+		{
+			PROFILE_SCOPE(STAGE_REFERENCE);
+			get_reference(ego, dt);
+		}
 
 		// 1b. Track laps to check if it's a new lap
-		track_lap(ego);
+		{
+			PROFILE_SCOPE(STAGE_LAP);
+			track_lap(ego);
+		}
 
 		// 2. Environment analysis, process the data from sensor fusion with prediction
-		process_sensor_fusion(ego, dt);
+		{
+			PROFILE_SCOPE(STAGE_SENSOR_FUSION);
+			process_sensor_fusion(ego, dt);
+		}
 
-		// 3. Behavior plan, create plann for target lane and speed
-		create_plan(ego, dt);
+		// 3-6. Search the best trajectory over all lanes, speeds and horizons
+		if (planning == PLANNING::SEARCH)
+		{
+			{
+				PROFILE_SCOPE(STAGE_TRAJECTORY);
+				search_trajectory(ego, path, dt);
+			}
 
-		// 4. Collision avoid
-		collision_avoidance();
+			// 7. Check the final trajectory against the predicted cars
+			{
+				PROFILE_SCOPE(STAGE_COLLISION);
+				check_trajectory(ego, path, dt);
+			}
+			sent_points = path.size();
+			return;
+		}
+
+		{
+			PROFILE_SCOPE(STAGE_PLAN);
+
+			// 3. Behavior plan, create plann for target lane and speed
+			create_plan(ego, dt);
 
-		// 5. Speed control
-		speed_control();
+			// 4. Collision avoid
+			collision_avoidance();
+		}
+
+		// 5. Speed control, the quintic engine limits its own acceleration
+		if (engine == ENGINE::SPLINE)
+		{
+			PROFILE_SCOPE(STAGE_SPEED_CONTROL);
+			speed_control();
+		}
 
 		// 6. Generate final trajectory
-		create_trajectory(ego, target_lane, target_speed, path, dt);
+		{
+			PROFILE_SCOPE(STAGE_TRAJECTORY);
+			if (engine == ENGINE::QUINTIC)
+				create_quintic_trajectory(ego, target_lane, target_speed, path, dt);
+			else
+			{
+				create_trajectory(ego, target_lane, target_speed, path, dt);
+				quintic_valid = false;
+			}
+		}
+
+		// 7. Check the final trajectory against the predicted cars
+		{
+			PROFILE_SCOPE(STAGE_COLLISION);
+			check_trajectory(ego, path, dt);
+		}
+		sent_points = path.size();
 
 	}
 
@@ -305,109 +556,208 @@ namespace carnd
 			ego_laps_tick = 0;
 			ego_passed_zero_s = false;
 
-			cout << "############### New Lap! ###################" << endl;
+			LOG_INFO("############### New Lap! ###################");
 		}
 		else
 		{
-			cout << "____________________________________________" << endl;
+			LOG_DEBUG("____________________________________________");
 
 		}
 
 		ego_laps_tick ++;
 
-		cout << endl
-			 << " LAP = " << (ego_laps + 1)
-		     << " LANE = " << lane.lane_at(ego.d)
-		     << " (s= " << fixed << setprecision(1) << ego.s
-		     << ", d= " << fixed << setprecision(1) << ego.d << ")"
-		     << " PLANNED " << ego.previous_path.size() << " points."
-		     << endl;
+		LOG_DEBUG("\n LAP = %d LANE = %d (s= %.1f, d= %.1f) PLANNED %d points.",
+				  ego_laps + 1, lane.lane_at(ego.d), ego.s, ego.d, ego.previous_path.size());
 	} // end PathPlanner::track_lap()
 
 	
 	// 2. Environment analysis, process the data from sensor fusion with prediction
 	void PathPlanner::process_sensor_fusion(const ego_t & ego, double dt)
 	{
-		cout << "##Sensor Fusion##" << endl;
-		lane_info.clear();
-		lane_info.resize(lane.lane_count);
+		LOG_DEBUG("##Sensor Fusion##");
+		// Reset the lane info in place
+		lane_info.assign(lane.lane_count, lane_info_t());
 
 		const int planned_size = ego.previous_path.size();
+		const cars_list & cars = ego.cars;
+
+		// Analysis all the car objects in sensor fusion at once
+		const double horizon = planned_size * dt;
+		analyze_cars(cars, horizon);
+
+		// Filter the cars over the ticks, the time between two ticks is the
+		// time of the points consumed from the last path
+		const double elapsed = max(0, sent_points - planned_size) * dt;
+		tracker.update(cars.id.data(), cars.s.data(), cars.d.data(), cars_speed.data(),
+					   cars.size(), elapsed, roadmap.max_s);
 
-		// Analysis each car objects in sensor fusion
-		for(auto & car : ego.cars)
+		// Sort the cars of each lane by s
+		cars_index.update(cars.s.data(), cars.id.data(), cars_lane.data(), cars.size(),
+						  lane.lane_count, roadmap.max_s);
+
+		// Roll out the cars and predict them at the horizon
+		predict_cars(cars);
+		for(size_t i = 0; i < cars.size(); i++)
 		{
-			// Get cars' lane
-			int car_lane = lane.lane_at(car.d);
-			// Only cars in same direction
-			if (car_lane >= 0)
-			{
-				lane_info_t & laneinfo = lane_info[car_lane];
-
-				// Predict car position assuming constant speed
-				double car_speed = norm(car.vx, car.vy);
-				double car_next_s = car.s + car_speed * planned_size * dt;
-				// Check if it's in front or back
-				bool in_front = car.s > ref_s;
-				// Absolute s distance from ego to car
-				double car_gap = car.s - ref_s;
-				double car_gap_next = car_next_s - ref_s;
-
-				cout << " CAR " << setw(2) << car.id
-					 << " lane=" << car_lane
-					 << " v=" << setw(4) << mps2mph(car_speed)
-					 << " gap=" << setw(4) << car_gap
-					 << " gap'=" << setw(4) << car_gap_next
-					 << endl;
-
-				// Check if distance is under buffer
-				// Check front
-				if (in_front == true)
-				{
-					if (car_gap < laneinfo.front_gap)
-					{
-						laneinfo.front_car = car.id;
-						laneinfo.front_gap = car_gap; 
-						laneinfo.front_speed = car_speed;
-						laneinfo.front_gap_next = car_gap_next;
-					}
-				}
-				// Check back
-				else if (car_gap > fmax(laneinfo.back_gap, -lane_horizon))
-				{
-					laneinfo.back_car = car.id;
-					laneinfo.back_gap = car_gap;
-					laneinfo.back_speed = car_speed;
-					laneinfo.back_gap_next = car_gap_next;
-				}
+			cars_next_s[i] = predictor.s_at(prediction_model, i, horizon);
+			cars_gap_next[i] = cars_next_s[i] - ref_s;
+		}
 
-				// Evaluate lane feasibility
-				laneinfo.feasible = (laneinfo.front_gap > lane_change_front_buffer)
-								&& (laneinfo.front_gap_next > lane_change_front_buffer)
-								&& (laneinfo.back_gap < lane_change_back_buffer)
-								&& (laneinfo.back_gap_next < lane_change_back_buffer);
+		// Occupancy of the lanes over the rollouts
+		occupancy.clear(lane.lane_count, predictor.n_steps, predictor.step, roadmap.max_s);
+		occupancy.fill(predictor, prediction_model, cars_lane.data(), lane.lane_width);
 
-				// Store the lane info
-				lane_info[car_lane] = laneinfo;
+		// Only cars in same direction
+		for(size_t i = 0; i < cars.size(); i++)
+		{
+			if (cars_lane[i] >= 0)
+				LOG_DEBUG(" CAR %2d lane=%d v=%4.1f gap=%4.1f gap'=%4.1f",
+						  cars.id[i], cars_lane[i], mps2mph(cars_speed[i]), cars_gap[i], cars_gap_next[i]);
+		}
+
+		for(int i = 0; i < lane.lane_count; i++)
+		{
+			lane_info_t & laneinfo = lane_info[i];
+			double gap;
+
+			// Closest car in front
+			const int front = cars_index.ahead(i, ref_s, gap);
+			if (front >= 0)
+			{
+				laneinfo.front_car = cars.id[front];
+				laneinfo.front_gap = gap; 
+				laneinfo.front_speed = cars_speed[front];
+				laneinfo.front_gap_next = gap + cars_next_s[front] - cars.s[front];
+			}
+
+			// Closest car in the back within the horizon
+			const int back = cars_index.behind(i, ref_s, gap);
+			if (back >= 0 && gap > -lane_horizon)
+			{
+				laneinfo.back_car = cars.id[back];
+				laneinfo.back_gap = gap;
+				laneinfo.back_speed = cars_speed[back];
+				laneinfo.back_gap_next = gap + cars_next_s[back] - cars.s[back];
+			}
 
-			} // end if (car_lane >= 0)
-		} // end for(car_t & car : ego.cars)
+			// Evaluate lane feasibility, no car around the reference until
+			// the end of the planned path
+			laneinfo.feasible = occupancy.is_free(i, ref_s + lane_change_back_buffer,
+												  ref_s + lane_change_front_buffer, 0, horizon);
+		}
 
 		for(int i = 0; i < lane_info.size(); i++)
 		{
-			cout << " LANE " << setw(2) << i
-			     << " front car=" << lane_info[i].front_car 
-			     << " back car=" << lane_info[i].back_car
-			     << " feasible=" << lane_info[i].feasible
-			     << endl;
+			LOG_DEBUG(" LANE %2d front car=%d back car=%d feasible=%d",
+					  i, lane_info[i].front_car, lane_info[i].back_car, lane_info[i].feasible);
 		}
 	} // end PathPlanner::process_sensor_fusion()
 
+	// Speed, predicted s at the horizon assuming constant speed, gaps to
+	// the reference and lane of all cars, -1 left and -2 right of the road
+	void PathPlanner::analyze_cars(const cars_list & cars, double horizon)
+	{
+		const size_t n = cars.size();
+		cars_speed.resize(n);
+		cars_next_s.resize(n);
+		cars_gap.resize(n);
+		cars_gap_next.resize(n);
+		cars_lane.resize(n);
+
+		size_t i = analyze_cars_kernel(cars, horizon);
+		for(; i < n; i++)
+		{
+			const double d = cars.d[i];
+			cars_speed[i] = norm(cars.vx[i], cars.vy[i]);
+			cars_next_s[i] = cars.s[i] + cars_speed[i] * horizon;
+			cars_gap[i] = cars.s[i] - ref_s;
+			cars_gap_next[i] = cars_next_s[i] - ref_s;
+			cars_lane[i] = d < 0 ? -1 :
+						   d > lane.road_width ? -2 :
+						   min((int)floor(d / lane.lane_width), lane.lane_count - 1);
+		}
+	}
+
+	// Roll out the cars under every model from their filtered state, the
+	// speed of the tracked cars is the filtered one
+	void PathPlanner::predict_cars(const cars_list & cars)
+	{
+		const size_t n = cars.size();
+		cars_accel.resize(n);
+		cars_d_dot.resize(n);
+		cars_leader.resize(n);
+
+		for(size_t i = 0; i < n; i++)
+		{
+			const track_t * track = tracker.at(i);
+			const bool tracked = track && track->updates > 1;
+			if (tracked)
+				cars_speed[i] = track->v;
+			cars_accel[i] = tracked ? track->a : 0;
+			cars_d_dot[i] = tracked ? track->d_dot : 0;
+
+			double gap;
+			cars_leader[i] = cars_lane[i] >= 0 ? cars_index.ahead(cars_lane[i], cars.s[i], gap) : -1;
+		}
+
+		prediction_input_t input;
+		input.s = cars.s.data();
+		input.v = cars_speed.data();
+		input.a = cars_accel.data();
+		input.d = cars.d.data();
+		input.d_dot = cars_d_dot.data();
+		input.lane = cars_lane.data();
+		input.leader = cars_leader.data();
+		input.n = n;
+		predictor.predict(input, roadmap.max_s);
+	}
+
+	// Vectorized analyze_cars, returns the number of cars analyzed
+	size_t PathPlanner::analyze_cars_kernel(const cars_list & cars, double horizon)
+	{
+		size_t i = 0;
+
+	#ifdef __AVX2__
+		const size_t n = cars.size();
+		const __m256d horizon_ = _mm256_set1_pd(horizon);
+		const __m256d ref_s_ = _mm256_set1_pd(ref_s);
+		const __m256d inv_width = _mm256_set1_pd(1 / lane.lane_width);
+		const __m256d road_width = _mm256_set1_pd(lane.road_width);
+		const __m256d last_lane = _mm256_set1_pd(lane.lane_count - 1);
+		const __m256d left = _mm256_set1_pd(-1);
+		const __m256d right = _mm256_set1_pd(-2);
+		const __m256d zero = _mm256_setzero_pd();
+
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m256d vx = _mm256_loadu_pd(cars.vx.data() + i);
+			const __m256d vy = _mm256_loadu_pd(cars.vy.data() + i);
+			const __m256d s = _mm256_loadu_pd(cars.s.data() + i);
+			const __m256d d = _mm256_loadu_pd(cars.d.data() + i);
+
+			const __m256d speed = _mm256_sqrt_pd(_mm256_fmadd_pd(vx, vx, _mm256_mul_pd(vy, vy)));
+			const __m256d next_s = _mm256_fmadd_pd(speed, horizon_, s);
+			_mm256_storeu_pd(cars_speed.data() + i, speed);
+			_mm256_storeu_pd(cars_next_s.data() + i, next_s);
+			_mm256_storeu_pd(cars_gap.data() + i, _mm256_sub_pd(s, ref_s_));
+			_mm256_storeu_pd(cars_gap_next.data() + i, _mm256_sub_pd(next_s, ref_s_));
+
+			// Lane from d, then the markers beyond the road
+			__m256d lane_ = _mm256_min_pd(_mm256_floor_pd(_mm256_mul_pd(d, inv_width)), last_lane);
+			lane_ = _mm256_blendv_pd(lane_, left, _mm256_cmp_pd(d, zero, _CMP_LT_OQ));
+			lane_ = _mm256_blendv_pd(lane_, right, _mm256_cmp_pd(d, road_width, _CMP_GT_OQ));
+			_mm_storeu_si128((__m128i *)(cars_lane.data() + i), _mm256_cvtpd_epi32(lane_));
+		}
+	#endif
+
+		return i;
+	}
+
 	
 	// 3. Behavior planning, create plann for target lane and speed
 	void PathPlanner::create_plan(const ego_t & ego, double dt)
 	{
-		cout << "##Planning##" << endl;
+		LOG_DEBUG("##Planning##");
 
 		// Get a safety margin
 		const double road_speed_limit = mph2mps(lane.speed_limit_mph) - 0.2;
@@ -423,9 +773,9 @@ namespace carnd
 
 		int best_lane = get_best_lane();
 
-		cout << " ** BEST  LANE = " << best_lane << endl;
-		cout << " ** REF   LANE = " << ref_lane << endl;
-		cout << " ** TARGETLANE = " << target_lane << endl;
+		LOG_DEBUG(" ** BEST  LANE = %d", best_lane);
+		LOG_DEBUG(" ** REF   LANE = %d", ref_lane);
+		LOG_DEBUG(" ** TARGETLANE = %d", target_lane);
 
 		while(true)
 		{
@@ -438,10 +788,8 @@ namespace carnd
 			if (state_ == STATE::KEEPLANE)
 			{
 				// assert( target_lane == ref_lane);
-				cout << " ** KEEP LANE = " << target_lane
-				     << " FOR " << setprecision(2) << meters_in_state << "m"
-				     << " (cte= " << setprecision(2) << setw(4) << cte << " m)"
-				     << endl;
+				LOG_DEBUG(" ** KEEP LANE = %d FOR %.2fm (cte= %4.2f m)",
+						  target_lane, meters_in_state, cte);
 
 				target_speed = road_speed_limit;
 
@@ -469,10 +817,8 @@ namespace carnd
 			{
 				// assert( changing_lane != ref_lane );
 
-				cout << " ** PREPARE CHANGE TO LANE = " << changing_lane
-				     << " FOR " << setprecision(2) << meters_in_state << "m"
-				     << " (cte= " << setprecision(2) << setw(4) << cte << " m)"
-				     << endl;
+				LOG_DEBUG(" ** PREPARE CHANGE TO LANE = %d FOR %.2fm (cte= %4.2f m)",
+						  changing_lane, meters_in_state, cte);
 
 				// If target lane is feasible, then change lane
 				if (lane_info[changing_lane].feasible && meters_in_state > 5)
@@ -509,10 +855,8 @@ namespace carnd
 			// Lane Change
 			else if (state_ == STATE::LANECHANGE)
 			{
-				cout << " ** CHANGING TO LANE = " << target_lane
-				     << " FOR " << setprecision(2) << meters_in_state << " m"
-				     << " cte=" << setprecision(2) << setw(4) << cte << " m)"
-				     << endl;
+				LOG_DEBUG(" ** CHANGING TO LANE = %d FOR %.2f m cte=%4.2f m)",
+						  target_lane, meters_in_state, cte);
 
 				// Accelerate when lane changning
 				target_speed = road_speed_limit;
@@ -538,7 +882,7 @@ namespace carnd
 				{
 					target_lane = ref_lane;
 					changing_lane = -1;
-					cout << " ** ABORTING LANE CHANGE " << endl;
+					LOG_INFO(" ** ABORTING LANE CHANGE ");
 				}
 
 				break;
@@ -569,8 +913,8 @@ namespace carnd
 				warning_collision = false;
 			}
 
-			cout << " ** FOLLOW THE LEAD (" << lane_info[ref_lane].front_gap << " m)" << endl;
-			cout << " ** COLLISIONWARNING = " << warning_collision << endl;
+			LOG_DEBUG(" ** FOLLOW THE LEAD (%.2f m)", lane_info[ref_lane].front_gap);
+			LOG_DEBUG(" ** COLLISIONWARNING = %d", warning_collision);
 		}
 	} // end PathPlanner::collision_avoidance()
 
@@ -580,7 +924,7 @@ namespace carnd
 		// Decelerate
 		if (target_speed < ref_v)
 		{
-			if (warning_collision == true)
+			if (warning_collision == true || path_collision)
 				target_speed = fmax(target_speed, ref_v - emergy_accel);
 			else
 				target_speed = fmax(target_speed, ref_v - accel);
@@ -602,58 +946,67 @@ namespace carnd
 										path_t & path, 
 										double dt)
 	{
-		cout << "##TRAJECTORY##" << endl
-			 << " ** TARGET LANE= " << target_lane
-			 << " ** TARGET SPEED= " << setprecision(1) << mps2mph(target_speed)
-			 << endl;
+		LOG_DEBUG("##TRAJECTORY##");
+		LOG_DEBUG(" ** TARGET LANE= %d ** TARGET SPEED= %.1f", target_lane, mps2mph(target_speed));
 
 		const double target_d = lane.safe_lane_center(target_lane);
 
 		// Trajectory points
-		path_t anchors;
+		const int n_anchors = 5;
+		double anchors_x[n_anchors], anchors_y[n_anchors];
 
 		// Build a path tengent to the previous end state
-		anchors.append(ref_x_prev, ref_y_prev);
-		anchors.append(ref_x, ref_y);
+		anchors_x[0] = ref_x_prev;
+		anchors_y[0] = ref_y_prev;
+		anchors_x[1] = ref_x;
+		anchors_y[1] = ref_y;
 
 		// Add three more points, each has 30m space
 		for(int i = 1; i <=3; i++)
 		{
 			xy_t next_wp = roadmap.to_xy(ref_s + lane_horizon * i, target_d);
-			anchors.append(next_wp);
+			anchors_x[i + 1] = next_wp.x;
+			anchors_y[i + 1] = next_wp.y;
 		}
 
 		// Change the points to reference coordinate
-		for(int i = 0; i < anchors.size(); i++)
+		for(int i = 0; i < n_anchors; i++)
 		{
-			const double dx = anchors.x[i] - ref_x;
-			const double dy = anchors.y[i] - ref_y;
-			anchors.x[i] = dx * cos(-ref_yaw) - dy * sin(-ref_yaw);
-			anchors.y[i] = dx * sin(-ref_yaw) + dy * cos(-ref_yaw);
+			const double dx = anchors_x[i] - ref_x;
+			const double dy = anchors_y[i] - ref_y;
+			anchors_x[i] = dx * cos(-ref_yaw) - dy * sin(-ref_yaw);
+			anchors_y[i] = dx * sin(-ref_yaw) + dy * cos(-ref_yaw);
 		}
 
 		// Interpolate the anchors with a cubic spline
-		tk::spline spline;
-		spline.set_points(anchors.x, anchors.y);
+		tk::small_spline<n_anchors> spline;
+		spline.set_points(anchors_x, anchors_y, n_anchors);
 
 		// Add previous path for continuity
 		path.x.assign(ego.previous_path.x.begin(), ego.previous_path.x.end());
 		path.y.assign(ego.previous_path.y.begin(), ego.previous_path.y.end());
 
-		// Set a horizon of 30m
-		const double target_x = lane_horizon;
-		const double target_y = spline(target_x);
-		const double target_dist = norm(target_x, target_y);
+		// Arc length along the spline over a horizon of 30m
+		arc_length.build(spline, 0, lane_horizon);
 
-		// t = N * dt = target_dist / target_speed
-		const double t = target_x / target_dist * dt;
+		// Half of the consumed points are refilled each tick
+		const int n_samples = max(0, (n_path_points + 1 - (int)path.size()) / 2);
+		samples_s.resize(n_samples);
+		samples_x.resize(n_samples);
+		samples_y.resize(n_samples);
 
-		
-		for(int i = 1; i <= n_path_points - path.x.size(); i++)
+		// Sample the spline curve every target_speed * dt along its length
+		for(int i = 0; i < n_samples; i++)
+		{
+			samples_s[i] = (i + 1) * target_speed * dt;
+		}
+		arc_length.inverse(spline, samples_s.data(), n_samples, samples_x.data());
+		spline.eval(samples_x.data(), n_samples, samples_y.data());
+
+		for(int i = 0; i < n_samples; i++)
 		{
-			// Sample the spline curve to reach the target speed
-			double x_spline = i * t * target_speed;
-			double y_spline = spline(x_spline);
+			double x_spline = samples_x[i];
+			double y_spline = samples_y[i];
 			// Transform back to world coordinate
 			double x_ = x_spline * cos(ref_yaw) - y_spline * sin(ref_yaw) + ref_x;
 			double y_ = x_spline * sin(ref_yaw) + y_spline * cos(ref_yaw) + ref_y;
@@ -664,4 +1017,187 @@ namespace carnd
 
 	} // end PathPlanner::create_trajectory()
 
+	// 6. Generate final trajectory with the best jerk minimal quintic candidate
+	void PathPlanner::create_quintic_trajectory(const ego_t & ego, 
+												const int target_lane, 
+												const double target_speed, 
+												path_t & path, 
+												double dt)
+	{
+		LOG_DEBUG("##QUINTIC TRAJECTORY##");
+		LOG_DEBUG(" ** TARGET LANE= %d ** TARGET SPEED= %.1f", target_lane, mps2mph(target_speed));
+
+		start_quintic(ego);
+
+		// Candidates for the end speeds toward the target and all the horizons
+		const double target_d = lane.safe_lane_center(target_lane);
+		quintic.max_speed = mph2mps(lane.speed_limit_mph);
+		quintic_speeds.resize(quintic_speed_fractions.size());
+		for(size_t i = 0; i < quintic_speeds.size(); i++)
+		{
+			quintic_speeds[i] = quintic_end.s_dot + quintic_speed_fractions[i] * (target_speed - quintic_end.s_dot);
+		}
+		quintic.generate(quintic_end, &target_d, 1,
+						 quintic_speeds.data(), quintic_speeds.size(),
+						 quintic_horizons.data(), quintic_horizons.size());
+		for(auto & candidate : quintic.candidates)
+		{
+			quintic.evaluate(candidate, target_speed);
+		}
+		const candidate_t & best = quintic.candidates[quintic.best()];
+
+		LOG_DEBUG(" ** CANDIDATES= %d BEST T= %.1f v= %.1f feasible= %d",
+				  quintic.candidates.size(), best.T, mps2mph(best.target_speed), best.feasible);
+
+		emit_quintic(ego, best, path, dt);
+
+	} // end PathPlanner::create_quintic_trajectory()
+
+	// 3-6. Search the best trajectory over all lanes, speeds and horizons
+	void PathPlanner::search_trajectory(const ego_t & ego, path_t & path, double dt)
+	{
+		LOG_DEBUG("##SEARCH##");
+
+		start_quintic(ego);
+
+		const double road_speed_limit = mph2mps(lane.speed_limit_mph) - 0.2;
+		search.generator.max_speed = mph2mps(lane.speed_limit_mph);
+
+		// Candidates ending in every lane center
+		search_lanes_d.resize(lane.lane_count);
+		lane_feasible.resize(lane.lane_count);
+		for(int i = 0; i < lane.lane_count; i++)
+		{
+			search_lanes_d[i] = lane.safe_lane_center(i);
+			lane_feasible[i] = lane_info[i].feasible;
+		}
+
+		// End speeds toward 0 or the speed limit
+		quintic_speeds.resize(search_speed_fractions.size());
+		for(size_t i = 0; i < quintic_speeds.size(); i++)
+		{
+			const double f = search_speed_fractions[i];
+			quintic_speeds[i] = f < 0 ?
+								quintic_end.s_dot * (1 + f) :
+								quintic_end.s_dot + f * (road_speed_limit - quintic_end.s_dot);
+		}
+
+		search_context_t ctx;
+		ctx.start = quintic_end;
+		ctx.t_start = ego.previous_path.size() * dt;
+		ctx.t_eval = quintic_horizons.back();
+		ctx.n_steps = 20;
+		ctx.max_s = roadmap.max_s;
+		ctx.speed_limit = road_speed_limit;
+		ctx.max_jerk = search.generator.max_jerk;
+		ctx.lane_width = lane.lane_width;
+		ctx.safe_gap = search_safe_gap;
+		ctx.min_gap = search_min_gap;
+		ctx.start_lane = ref_lane;
+		ctx.lane_feasible = lane_feasible.data();
+		ctx.lane_count = lane.lane_count;
+		ctx.prediction = &predictor;
+		ctx.model = prediction_model;
+		ctx.cars_lane = cars_lane.data();
+
+		const int best_index = search.run(ctx,
+										  search_lanes_d.data(), search_lanes_d.size(),
+										  quintic_speeds.data(), quintic_speeds.size(),
+										  quintic_horizons.data(), quintic_horizons.size(),
+										  workers);
+		const candidate_t & best = search.generator.candidates[best_index];
+
+		target_lane = lane.lane_at(best.target_d);
+		target_speed = best.target_speed;
+
+		LOG_DEBUG(" ** CANDIDATES= %d WORKERS= %d BEST LANE= %d T= %.1f v= %.1f cost= %.3f feasible= %d",
+				  search.generator.candidates.size(), workers.size(), target_lane,
+				  best.T, mps2mph(best.target_speed), best.cost, best.feasible);
+
+		emit_quintic(ego, best, path, dt);
+
+	} // end PathPlanner::search_trajectory()
+
+	// Continue from the end of the last quintic path, or from the reference
+	// point when the previous path came from elsewhere
+	void PathPlanner::start_quintic(const ego_t & ego)
+	{
+		if (!quintic_valid || ego.previous_path.size() == 0)
+			quintic_end = {ref_s, ref_v, 0, ref_d, 0, 0};
+	}
+
+	// Append the candidate to the previous path and keep its end state
+	void PathPlanner::emit_quintic(const ego_t & ego, const candidate_t & best, path_t & path, double dt)
+	{
+		// Add previous path for continuity
+		path.x.assign(ego.previous_path.x.begin(), ego.previous_path.x.end());
+		path.y.assign(ego.previous_path.y.begin(), ego.previous_path.y.end());
+
+		// Refill the path with the best candidate every dt
+		const int n_samples = max(0, n_path_points - (int)path.size());
+		samples_s.resize(n_samples);
+		samples_d.resize(n_samples);
+		samples_x.resize(n_samples);
+		samples_y.resize(n_samples);
+		for(int i = 0; i < n_samples; i++)
+		{
+			const frenet_state_t state = best.at((i + 1) * dt);
+			samples_s[i] = state.s;
+			samples_d[i] = state.d;
+		}
+		roadmap.to_xy(samples_s.data(), samples_d.data(), n_samples, samples_x.data(), samples_y.data());
+
+		for(int i = 0; i < n_samples; i++)
+		{
+			path.append(samples_x[i], samples_y[i]);
+		}
+
+		// Keep the end state for the next path
+		if (n_samples > 0)
+		{
+			quintic_end = best.at(n_samples * dt);
+			quintic_end.s = fmod(quintic_end.s, roadmap.max_s);
+		}
+		quintic_valid = true;
+
+	} // end PathPlanner::emit_quintic()
+
+	// 7. Check the final trajectory against the predicted cars, its first
+	// point is dt after the sensor fusion data
+	void PathPlanner::check_trajectory(const ego_t & ego, const path_t & path, double dt)
+	{
+		const size_t n = path.size();
+
+		// The points kept from the last path keep their frenet coordinates
+		const size_t kept = ego.previous_path.size();
+		size_t known = 0;
+		if (path_s.size() == (size_t)sent_points && (size_t)sent_points >= kept && kept <= n)
+		{
+			const size_t consumed = sent_points - kept;
+			path_s.erase(path_s.begin(), path_s.begin() + consumed);
+			path_d.erase(path_d.begin(), path_d.begin() + consumed);
+			known = kept;
+		}
+
+		path_theta.resize(n);
+		path_s.resize(n);
+		path_d.resize(n);
+		for(size_t i = known; i < n; i++)
+		{
+			const size_t a = i + 1 < n ? i : i - min(i, (size_t)1);
+			const size_t b = i + 1 < n ? i + 1 : i;
+			path_theta[i] = atan2(path.y[b] - path.y[a], path.x[b] - path.x[a]);
+		}
+		roadmap.to_frenet(path.x.data() + known, path.y.data() + known, path_theta.data() + known, n - known,
+						  path_s.data() + known, path_d.data() + known, path_cursor);
+
+		collision.prepare(predictor, prediction_model, cars_lane.data(), roadmap, n * dt);
+		int car = -1;
+		const int hit = collision.check(path.x.data(), path.y.data(), path_s.data(), n, dt, dt, &car);
+		path_collision = hit >= 0;
+		if (path_collision)
+			LOG_WARN(" ** COLLISION PREDICTED in %.2fs with car %d", (hit + 1) * dt, ego.cars.id[car]);
+
+	} // end PathPlanner::check_trajectory()
+
 } // namespace carnd
\ No newline at end of file
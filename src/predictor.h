@@ -0,0 +1,342 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Motion hypotheses of the predicted cars
+	enum PREDICTION_MODEL
+	{
+		MODEL_CV,     // constant velocity in its lane
+		MODEL_CA,     // constant acceleration until it stops
+		MODEL_LCL,    // lane change to the left at constant velocity
+		MODEL_LCR,    // lane change to the right at constant velocity
+		MODEL_IDM,    // intelligent driver model behind the car ahead
+		MODEL_LIKELY, // most likely of the above for each car
+		PREDICTION_MODELS
+	};
+
+	// Cars to predict, in columns
+	struct prediction_input_t
+	{
+		const double *s, *v, *a; // along the road
+		const double *d, *d_dot; // across the road
+		const int *lane;         // lane of each car, < 0 off the road
+		const int *leader;       // index of the car ahead in its lane, < 0 if none
+		size_t n;
+	};
+
+	// Rollouts of the cars under every model, time major: the s and d of
+	// all the cars at one time step are contiguous floats. s is not
+	// wrapped at the end of the road loop.
+	class Predictor
+	{
+	public:
+		double step = 0.1;  // s, between two rollout steps
+		int n_steps = 10;   // rollout steps after the present
+
+		double lane_width = 4; // m
+		int lane_count = 3;
+		double lane_change_time = 3.0; // s
+		double lane_change_rate = 0.5; // m/s, d rate of a likely lane change
+
+		// Intelligent driver model, the desired speed is the current one
+		double idm_time_gap = 1.5;  // s
+		double idm_min_gap = 2.0;   // m
+		double idm_accel = 1.5;     // m/s^2
+		double idm_decel = 2.0;     // m/s^2, comfortable
+		double idm_max_decel = 9.0; // m/s^2
+		double car_length = 5.0;    // m
+
+		// Reserve the buffers for n cars
+		void reserve(size_t n);
+
+		// Roll out the cars under every model, the road loops at max_s
+		void predict(const prediction_input_t &input, double max_s);
+
+		size_t size() const { return n_; }
+		double horizon() const { return step * n_steps; }
+
+		// s and d of all the cars at a rollout step
+		const float *s_row(int model, int k) const { return &s_[offset(model, k)]; }
+		const float *d_row(int model, int k) const { return &d_[offset(model, k)]; }
+
+		// Rollout step and weight of the next step for the time t, the
+		// rollout is extended linearly beyond the horizon
+		void sample(double t, int &k, float &w) const;
+
+		// s and d of a car at the time t
+		double s_at(int model, size_t car, double t) const;
+		double d_at(int model, size_t car, double t) const;
+
+	private:
+		size_t offset(int model, int k) const { return ((size_t)model * (n_steps + 1) + k) * stride_; }
+
+		// Constant velocity, acceleration and lane change rows at the time t
+		void motion_row(int k, double t);
+		size_t motion_row_kernel(int k, double t);
+		// Intelligent driver model row from the previous one
+		void idm_row(int k);
+		size_t idm_row_kernel(int k);
+
+		size_t n_ = 0;
+		size_t stride_ = 0;
+		vector<float> s_, d_;
+		// Initial state and model constants of each car
+		vector<float> s0_, v0_, a0_, d0_, t_stop_, d_left_, d_right_;
+		// IDM speed and leader state at the current step
+		vector<float> idm_v_, lead_s_, lead_v_, lead_offset_;
+		vector<int> leader_, likely_;
+	};
+
+	void Predictor::reserve(size_t n)
+	{
+		const size_t stride = (n + 7) & ~(size_t)7;
+		s_.reserve(PREDICTION_MODELS * (n_steps + 1) * stride);
+		d_.reserve(PREDICTION_MODELS * (n_steps + 1) * stride);
+		for (auto v : {&s0_, &v0_, &a0_, &d0_, &t_stop_, &d_left_, &d_right_,
+					   &idm_v_, &lead_s_, &lead_v_, &lead_offset_})
+			v->reserve(stride);
+		leader_.reserve(stride);
+		likely_.reserve(stride);
+	}
+
+	void Predictor::predict(const prediction_input_t &in, double max_s)
+	{
+		// Rows padded to whole vectors, the padding cars stand still
+		n_ = in.n;
+		stride_ = (n_ + 7) & ~(size_t)7;
+		s_.resize(PREDICTION_MODELS * (n_steps + 1) * stride_);
+		d_.resize(s_.size());
+		for (auto v : {&s0_, &v0_, &a0_, &d0_, &t_stop_, &d_left_, &d_right_,
+					   &idm_v_, &lead_s_, &lead_v_, &lead_offset_})
+			v->assign(stride_, 0);
+		leader_.assign(stride_, -1);
+		likely_.assign(stride_, MODEL_CV);
+
+		for (size_t i = 0; i < n_; i++)
+		{
+			s0_[i] = in.s[i];
+			v0_[i] = in.v[i];
+			a0_[i] = in.a[i];
+			d0_[i] = in.d[i];
+			// Time when a decelerating car stops
+			t_stop_[i] = in.a[i] < 0 ? -in.v[i] / in.a[i] : INFINITY;
+
+			// Lane centers on both sides, the car keeps its d without a lane
+			const int lane = in.lane[i];
+			d_left_[i] = lane > 0 ? (lane - 0.5) * lane_width : in.d[i];
+			d_right_[i] = lane >= 0 && lane < lane_count - 1 ? (lane + 1.5) * lane_width : in.d[i];
+
+			// The leader is ahead, a lap further if it is past the end of the road
+			leader_[i] = in.leader[i];
+			if (leader_[i] >= 0)
+				lead_offset_[i] = in.s[leader_[i]] < in.s[i] ? max_s : 0;
+
+			likely_[i] = in.d_dot[i] < -lane_change_rate && lane > 0 ? MODEL_LCL :
+						 in.d_dot[i] > lane_change_rate && lane >= 0 && lane < lane_count - 1 ? MODEL_LCR :
+						 MODEL_IDM;
+		}
+		idm_v_ = v0_;
+
+		for (int k = 0; k <= n_steps; k++)
+		{
+			motion_row(k, k * step);
+			if (k == 0)
+				copy(s_row(MODEL_CV, 0), s_row(MODEL_CV, 0) + stride_, s_.begin() + offset(MODEL_IDM, 0));
+			else
+				idm_row(k);
+			copy(d_row(MODEL_CV, k), d_row(MODEL_CV, k) + stride_, d_.begin() + offset(MODEL_IDM, k));
+
+			// Gather the likely model of each car
+			float *s = &s_[offset(MODEL_LIKELY, k)];
+			float *d = &d_[offset(MODEL_LIKELY, k)];
+			for (size_t i = 0; i < n_; i++)
+			{
+				const size_t j = offset(likely_[i], k) + i;
+				s[i] = s_[j];
+				d[i] = d_[j];
+			}
+		}
+	}
+
+	void Predictor::motion_row(int k, double t)
+	{
+		float *s_cv = &s_[offset(MODEL_CV, k)];
+		float *s_ca = &s_[offset(MODEL_CA, k)];
+		float *s_lcl = &s_[offset(MODEL_LCL, k)];
+		float *s_lcr = &s_[offset(MODEL_LCR, k)];
+		float *d_cv = &d_[offset(MODEL_CV, k)];
+		float *d_ca = &d_[offset(MODEL_CA, k)];
+		float *d_lcl = &d_[offset(MODEL_LCL, k)];
+		float *d_lcr = &d_[offset(MODEL_LCR, k)];
+
+		// Jerk minimal progress of the lane changes
+		const double u = min(t / lane_change_time, 1.0);
+		const float progress = u * u * u * (10 - 15 * u + 6 * u * u);
+
+		size_t i = motion_row_kernel(k, t);
+		for (; i < stride_; i++)
+		{
+			const float te = min((float)t, t_stop_[i]);
+			s_cv[i] = s_lcl[i] = s_lcr[i] = s0_[i] + v0_[i] * t;
+			s_ca[i] = s0_[i] + (v0_[i] + 0.5f * a0_[i] * te) * te;
+			d_cv[i] = d_ca[i] = d0_[i];
+			d_lcl[i] = d0_[i] + (d_left_[i] - d0_[i]) * progress;
+			d_lcr[i] = d0_[i] + (d_right_[i] - d0_[i]) * progress;
+		}
+	}
+
+	// Vectorized motion_row, returns the number of cars predicted
+	size_t Predictor::motion_row_kernel(int k, double t)
+	{
+		size_t i = 0;
+
+	#ifdef __AVX2__
+		float *s_cv = &s_[offset(MODEL_CV, k)];
+		float *s_ca = &s_[offset(MODEL_CA, k)];
+		float *s_lcl = &s_[offset(MODEL_LCL, k)];
+		float *s_lcr = &s_[offset(MODEL_LCR, k)];
+		float *d_cv = &d_[offset(MODEL_CV, k)];
+		float *d_ca = &d_[offset(MODEL_CA, k)];
+		float *d_lcl = &d_[offset(MODEL_LCL, k)];
+		float *d_lcr = &d_[offset(MODEL_LCR, k)];
+
+		const double u = min(t / lane_change_time, 1.0);
+		const __m256 progress = _mm256_set1_ps(u * u * u * (10 - 15 * u + 6 * u * u));
+		const __m256 t_ = _mm256_set1_ps(t);
+		const __m256 half = _mm256_set1_ps(0.5f);
+
+		for (; i + 8 <= stride_; i += 8)
+		{
+			const __m256 s0 = _mm256_loadu_ps(&s0_[i]);
+			const __m256 v0 = _mm256_loadu_ps(&v0_[i]);
+			const __m256 a0 = _mm256_loadu_ps(&a0_[i]);
+			const __m256 d0 = _mm256_loadu_ps(&d0_[i]);
+			const __m256 te = _mm256_min_ps(t_, _mm256_loadu_ps(&t_stop_[i]));
+
+			const __m256 s_cv_ = _mm256_fmadd_ps(v0, t_, s0);
+			_mm256_storeu_ps(s_cv + i, s_cv_);
+			_mm256_storeu_ps(s_lcl + i, s_cv_);
+			_mm256_storeu_ps(s_lcr + i, s_cv_);
+			_mm256_storeu_ps(s_ca + i, _mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_mul_ps(half, a0), te, v0), te, s0));
+
+			_mm256_storeu_ps(d_cv + i, d0);
+			_mm256_storeu_ps(d_ca + i, d0);
+			_mm256_storeu_ps(d_lcl + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(&d_left_[i]), d0), progress, d0));
+			_mm256_storeu_ps(d_lcr + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(&d_right_[i]), d0), progress, d0));
+		}
+	#endif
+
+		return i;
+	}
+
+	void Predictor::idm_row(int k)
+	{
+		// Leader state at the previous step, far ahead without a leader
+		const float *s_prev = s_row(MODEL_IDM, k - 1);
+		for (size_t i = 0; i < stride_; i++)
+		{
+			const int leader = leader_[i];
+			lead_s_[i] = leader >= 0 ? s_prev[leader] + lead_offset_[i] : s_prev[i] + 1e6f;
+			lead_v_[i] = leader >= 0 ? idm_v_[leader] : idm_v_[i];
+		}
+
+		const float two_sqrt_ab = 2 * sqrt(idm_accel * idm_decel);
+		const float dt = step;
+		float *s = &s_[offset(MODEL_IDM, k)];
+
+		size_t i = idm_row_kernel(k);
+		for (; i < stride_; i++)
+		{
+			const float v = idm_v_[i];
+			const float gap = max(lead_s_[i] - s_prev[i] - (float)car_length, 0.1f);
+			const float desired = idm_min_gap + max(0.0f, v * (float)idm_time_gap + v * (v - lead_v_[i]) / two_sqrt_ab);
+			// Free road term toward the current speed, a stopped car stays stopped
+			const float ratio = v0_[i] > 0 ? v / v0_[i] : 1.0f;
+			const float accel = max((float)idm_accel * (1 - ratio * ratio * ratio * ratio - (desired / gap) * (desired / gap)),
+									(float)-idm_max_decel);
+			const float v_next = max(v + accel * dt, 0.0f);
+			s[i] = s_prev[i] + 0.5f * (v + v_next) * dt;
+			idm_v_[i] = v_next;
+		}
+	}
+
+	// Vectorized idm_row, returns the number of cars predicted
+	size_t Predictor::idm_row_kernel(int k)
+	{
+		size_t i = 0;
+
+	#ifdef __AVX2__
+		const float *s_prev = s_row(MODEL_IDM, k - 1);
+		float *s = &s_[offset(MODEL_IDM, k)];
+
+		const __m256 inv_sqrt_ab = _mm256_set1_ps(1 / (2 * sqrt(idm_accel * idm_decel)));
+		const __m256 dt = _mm256_set1_ps(step);
+		const __m256 half_dt = _mm256_set1_ps(0.5 * step);
+		const __m256 length = _mm256_set1_ps(car_length);
+		const __m256 min_gap = _mm256_set1_ps(idm_min_gap);
+		const __m256 time_gap = _mm256_set1_ps(idm_time_gap);
+		const __m256 accel_ = _mm256_set1_ps(idm_accel);
+		const __m256 max_decel = _mm256_set1_ps(-idm_max_decel);
+		const __m256 one = _mm256_set1_ps(1);
+		const __m256 tenth = _mm256_set1_ps(0.1f);
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (; i + 8 <= stride_; i += 8)
+		{
+			const __m256 v = _mm256_loadu_ps(&idm_v_[i]);
+			const __m256 sp = _mm256_loadu_ps(s_prev + i);
+			const __m256 gap = _mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(&lead_s_[i]), sp), length), tenth);
+			const __m256 closing = _mm256_mul_ps(_mm256_mul_ps(v, _mm256_sub_ps(v, _mm256_loadu_ps(&lead_v_[i]))), inv_sqrt_ab);
+			const __m256 desired = _mm256_add_ps(min_gap, _mm256_max_ps(zero, _mm256_fmadd_ps(v, time_gap, closing)));
+			const __m256 v0 = _mm256_loadu_ps(&v0_[i]);
+			const __m256 ratio = _mm256_blendv_ps(one, _mm256_div_ps(v, v0), _mm256_cmp_ps(v0, zero, _CMP_GT_OQ));
+			const __m256 ratio2 = _mm256_mul_ps(ratio, ratio);
+			const __m256 q = _mm256_div_ps(desired, gap);
+			const __m256 free_ = _mm256_sub_ps(one, _mm256_mul_ps(ratio2, ratio2));
+			const __m256 accel = _mm256_max_ps(_mm256_mul_ps(accel_, _mm256_fnmadd_ps(q, q, free_)), max_decel);
+			const __m256 v_next = _mm256_max_ps(_mm256_fmadd_ps(accel, dt, v), zero);
+			_mm256_storeu_ps(s + i, _mm256_fmadd_ps(_mm256_add_ps(v, v_next), half_dt, sp));
+			_mm256_storeu_ps(&idm_v_[i], v_next);
+		}
+	#endif
+
+		return i;
+	}
+
+	void Predictor::sample(double t, int &k, float &w) const
+	{
+		const double x = max(t, 0.0) / step;
+		k = min((int)x, n_steps - 1);
+		w = x - k;
+	}
+
+	double Predictor::s_at(int model, size_t car, double t) const
+	{
+		int k;
+		float w;
+		sample(t, k, w);
+		const float s = s_row(model, k)[car];
+		return s + w * (s_row(model, k + 1)[car] - s);
+	}
+
+	double Predictor::d_at(int model, size_t car, double t) const
+	{
+		int k;
+		float w;
+		sample(t, k, w);
+		const float d = d_row(model, k)[car];
+		return d + w * (d_row(model, k + 1)[car] - d);
+	}
+
+} // namespace carnd
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+
+// Stage timers are compiled out with CARND_PROFILE=0
+#ifndef CARND_PROFILE
+#define CARND_PROFILE 1
+#endif
+
+#define CARND_CONCAT_(a, b) a##b
+#define CARND_CONCAT(a, b) CARND_CONCAT_(a, b)
+
+#if CARND_PROFILE
+// Time the rest of the enclosing scope as the given stage
+#define PROFILE_SCOPE(stage) carnd::scoped_timer CARND_CONCAT(profile_timer_, __LINE__)(stage)
+#else
+#define PROFILE_SCOPE(stage) do {} while (0)
+#endif
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Timed stages of a tick
+	enum PROFILE_STAGE
+	{
+		STAGE_TICK,           // whole PathPlanner::run
+		STAGE_REFERENCE,      // 1a. get_reference
+		STAGE_LAP,            // 1b. track_lap
+		STAGE_SENSOR_FUSION,  // 2. process_sensor_fusion
+		STAGE_PLAN,           // 3. create_plan and 4. collision_avoidance
+		STAGE_SPEED_CONTROL,  // 5. speed_control
+		STAGE_TRAJECTORY,     // 6. trajectory, or the candidates search
+		STAGE_COLLISION,      // 7. check_trajectory
+		STAGE_PARSE,          // telemetry message to ego_t
+		STAGE_SERIALIZE,      // next path to control message
+		PROFILE_STAGES
+	};
+
+	// Latency histogram with log linear buckets, 32 linear sub buckets per
+	// power of 2 so that a bucket is within about 3% of its values
+	struct latency_histogram
+	{
+		static const int sub_bits = 5;
+		static const int sub_count = 1 << sub_bits;
+		static const int max_magnitude = 34; // up to 2^40 ns
+		static const int bucket_count = (max_magnitude + 2) * sub_count;
+
+		array<uint64_t, bucket_count> counts;
+		uint64_t total = 0;
+		uint64_t max = 0;
+		uint64_t sum = 0;
+
+		latency_histogram() { reset(); }
+
+		void reset();
+
+		// Add a value in ns
+		void record(uint64_t ns);
+
+		// Value at the quantile q in [0, 1], the upper bound of its bucket
+		uint64_t percentile(double q) const;
+
+		double mean() const { return total ? (double)sum / total : 0; }
+
+		static int bucket(uint64_t ns);
+		// Highest value in a bucket
+		static uint64_t bucket_max(int index);
+	};
+
+	void latency_histogram::reset()
+	{
+		counts.fill(0);
+		total = 0;
+		max = 0;
+		sum = 0;
+	}
+
+	int latency_histogram::bucket(uint64_t ns)
+	{
+		if (ns < 2 * sub_count)
+			return (int)ns;
+		int magnitude = 63 - __builtin_clzll(ns) - sub_bits;
+		if (magnitude > max_magnitude)
+			return bucket_count - 1;
+		return magnitude * sub_count + (int)(ns >> magnitude);
+	}
+
+	uint64_t latency_histogram::bucket_max(int index)
+	{
+		if (index < 2 * sub_count)
+			return index;
+		const int magnitude = index / sub_count - 1;
+		const uint64_t top = index - magnitude * sub_count;
+		return ((top + 1) << magnitude) - 1;
+	}
+
+	void latency_histogram::record(uint64_t ns)
+	{
+		counts[bucket(ns)]++;
+		total++;
+		sum += ns;
+		max = std::max(max, ns);
+	}
+
+	uint64_t latency_histogram::percentile(double q) const
+	{
+		if (total == 0)
+			return 0;
+		const uint64_t rank = std::max<uint64_t>(1, (uint64_t)ceil(q * total));
+		uint64_t count = 0;
+		for (int i = 0; i < bucket_count; i++)
+		{
+			count += counts[i];
+			if (count >= rank)
+				return std::min(bucket_max(i), max);
+		}
+		return max;
+	}
+
+	// Latency histograms of the tick stages, recorded and dumped by the
+	// planner thread
+	struct Profiler
+	{
+		array<latency_histogram, PROFILE_STAGES> stages;
+		// Dump requested from a signal handler
+		atomic<bool> dump_requested{false};
+		// Dump at exit if set
+		FILE *exit_output = nullptr;
+
+		~Profiler()
+		{
+			if (exit_output)
+				dump(exit_output);
+		}
+
+		static const char *stage_name(int stage);
+
+		void record(int stage, uint64_t ns) { stages[stage].record(ns); }
+		void reset();
+
+		// Print the count, mean, p50, p99, p99.9 and max of every stage in us
+		void dump(FILE *output) const;
+
+		// Dump if requested since the last call
+		void dump_if_requested(FILE *output);
+	};
+
+	const char *Profiler::stage_name(int stage)
+	{
+		static const char *names[PROFILE_STAGES] = {
+			"tick", "reference", "lap", "sensor_fusion", "plan",
+			"speed_control", "trajectory", "collision", "parse", "serialize" };
+		return names[stage];
+	}
+
+	void Profiler::reset()
+	{
+		for (auto &stage : stages)
+			stage.reset();
+	}
+
+	void Profiler::dump(FILE *output) const
+	{
+		fprintf(output, "%-14s %10s %10s %10s %10s %10s %10s\n",
+				"stage (us)", "count", "mean", "p50", "p99", "p99.9", "max");
+		for (int i = 0; i < PROFILE_STAGES; i++)
+		{
+			const latency_histogram &h = stages[i];
+			if (h.total == 0)
+				continue;
+			fprintf(output, "%-14s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+					stage_name(i), (unsigned long long)h.total, h.mean() * 1e-3,
+					h.percentile(0.5) * 1e-3, h.percentile(0.99) * 1e-3,
+					h.percentile(0.999) * 1e-3, h.max * 1e-3);
+		}
+		fflush(output);
+	}
+
+	void Profiler::dump_if_requested(FILE *output)
+	{
+		if (dump_requested.exchange(false))
+			dump(output);
+	}
+
+	// Process wide profiler
+	Profiler &profiler()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	// Records the time from its construction to its destruction
+	struct scoped_timer
+	{
+		int stage;
+		chrono::steady_clock::time_point start;
+
+		explicit scoped_timer(int stage_) : stage(stage_), start(chrono::steady_clock::now()) {}
+		~scoped_timer()
+		{
+			const auto elapsed = chrono::steady_clock::now() - start;
+			profiler().record(stage, chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+		}
+	};
+
+} // namespace carnd
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "utils.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Quintic polynomial x(t) = c0 + c1*t + c2*t^2 + c3*t^3 + c4*t^4 + c5*t^5
+	struct quintic_t
+	{
+		double c[6];
+
+		double x(double t) const { return ((((c[5] * t + c[4]) * t + c[3]) * t + c[2]) * t + c[1]) * t + c[0]; }
+		double v(double t) const { return (((5 * c[5] * t + 4 * c[4]) * t + 3 * c[3]) * t + 2 * c[2]) * t + c[1]; }
+		double a(double t) const { return ((20 * c[5] * t + 12 * c[4]) * t + 6 * c[3]) * t + 2 * c[2]; }
+		double j(double t) const { return (60 * c[5] * t + 24 * c[4]) * t + 6 * c[3]; }
+
+		// Integral of the squared jerk over [0, T]
+		double jerk_cost(double T) const;
+
+		// Jerk minimal polynomial from the start to the end position, velocity
+		// and acceleration in T seconds, with the closed form inverse of the
+		// 3x3 system of the end conditions
+		static quintic_t solve(double x0, double v0, double a0,
+							   double x1, double v1, double a1, double T);
+	};
+
+	double quintic_t::jerk_cost(double T) const
+	{
+		// j(t) = p0 + p1*t + p2*t^2
+		const double p0 = 6 * c[3], p1 = 24 * c[4], p2 = 60 * c[5];
+		const double T2 = T * T, T3 = T2 * T;
+		return p0 * p0 * T + p0 * p1 * T2 + (p1 * p1 + 2 * p0 * p2) * T3 / 3
+			 + p1 * p2 * T2 * T2 / 2 + p2 * p2 * T3 * T2 / 5;
+	}
+
+	quintic_t quintic_t::solve(double x0, double v0, double a0,
+							   double x1, double v1, double a1, double T)
+	{
+		const double T2 = T * T, T3 = T2 * T;
+
+		// Remaining end conditions once the start state is set
+		const double dx = x1 - (x0 + v0 * T + 0.5 * a0 * T2);
+		const double dv = v1 - (v0 + a0 * T);
+		const double da = a1 - a0;
+
+		quintic_t q;
+		q.c[0] = x0;
+		q.c[1] = v0;
+		q.c[2] = 0.5 * a0;
+		q.c[3] = (10 * dx - 4 * dv * T + 0.5 * da * T2) / T3;
+		q.c[4] = (-15 * dx + 7 * dv * T - da * T2) / (T3 * T);
+		q.c[5] = (6 * dx - 3 * dv * T + 0.5 * da * T2) / (T3 * T2);
+		return q;
+	}
+
+	// Frenet state with velocity and acceleration
+	struct frenet_state_t
+	{
+		double s, s_dot, s_ddot;
+		double d, d_dot, d_ddot;
+	};
+
+	// Trajectory candidate, quintic polynomials in s and d over T seconds
+	// then constant velocity
+	struct candidate_t
+	{
+		quintic_t s, d;
+		double T;
+		double target_d, target_speed;
+		double cost;
+		bool feasible;
+
+		// State at time t
+		frenet_state_t at(double t) const;
+	};
+
+	frenet_state_t candidate_t::at(double t) const
+	{
+		if (t <= T)
+			return { s.x(t), s.v(t), s.a(t), d.x(t), d.v(t), d.a(t) };
+
+		// Keep the end velocity after the horizon
+		const double v = s.v(T);
+		return { s.x(T) + v * (t - T), v, 0, d.x(T), 0, 0 };
+	}
+
+	// Jerk minimal trajectory generator, building candidates for a grid of
+	// end lateral positions, end speeds and horizons from a start state
+	struct QuinticGenerator
+	{
+		// Limits for feasible candidates
+		double max_speed = 22; // m/s
+		double max_accel = 5; // m/s^2
+		double max_jerk = 9; // m/s^3
+		// Points checked along each candidate
+		int n_checks = 10;
+
+		// Cost weights
+		double w_jerk = 1;
+		double w_speed = 10;
+		double w_time = 1;
+
+		vector<candidate_t> candidates;
+
+		// Build the candidates for all the end conditions, the end state has
+		// zero lateral velocity and zero accelerations
+		void generate(const frenet_state_t &start,
+					  const double *end_d, int n_d,
+					  const double *end_v, int n_v,
+					  const double *horizons, int n_T);
+
+		// Check the speed, acceleration and jerk limits along a candidate
+		bool check(const candidate_t &candidate) const;
+
+		// Check the limits and compute the jerk, speed and time cost of a candidate
+		void evaluate(candidate_t &candidate, double target_speed) const;
+
+		// Best feasible candidate, or the least costly one if none is feasible
+		int best() const;
+	};
+
+	void QuinticGenerator::generate(const frenet_state_t &start,
+									const double *end_d, int n_d,
+									const double *end_v, int n_v,
+									const double *horizons, int n_T)
+	{
+		candidates.resize(n_d * n_v * n_T);
+
+		int i = 0;
+		for (int k = 0; k < n_T; k++)
+		{
+			const double T = horizons[k];
+			for (int j = 0; j < n_v; j++)
+			{
+				// Reach the end speed with a constant acceleration estimate
+				const double v = end_v[j];
+				const quintic_t s = quintic_t::solve(start.s, start.s_dot, start.s_ddot,
+													 start.s + 0.5 * (start.s_dot + v) * T, v, 0, T);
+				for (int l = 0; l < n_d; l++, i++)
+				{
+					candidate_t &c = candidates[i];
+					c.s = s;
+					c.d = quintic_t::solve(start.d, start.d_dot, start.d_ddot, end_d[l], 0, 0, T);
+					c.T = T;
+					c.target_d = end_d[l];
+					c.target_speed = v;
+					c.cost = 0;
+					c.feasible = true;
+				}
+			}
+		}
+	}
+
+	bool QuinticGenerator::check(const candidate_t &c) const
+	{
+		for (int k = 1; k <= n_checks; k++)
+		{
+			const double t = c.T * k / n_checks;
+			const double v = c.s.v(t);
+			const double a = norm(c.s.a(t), c.d.a(t));
+			const double j = norm(c.s.j(t), c.d.j(t));
+			if (v < 0 || v > max_speed || a > max_accel || j > max_jerk)
+				return false;
+		}
+		return true;
+	}
+
+	void QuinticGenerator::evaluate(candidate_t &c, double target_speed) const
+	{
+		c.feasible = check(c);
+
+		const double dv = target_speed - c.target_speed;
+		c.cost = w_jerk * (c.s.jerk_cost(c.T) + c.d.jerk_cost(c.T))
+			   + w_speed * dv * dv
+			   + w_time * c.T;
+	}
+
+	int QuinticGenerator::best() const
+	{
+		int best = -1;
+		for (int i = 0; i < (int)candidates.size(); i++)
+		{
+			const candidate_t &c = candidates[i];
+			if (best < 0
+				|| (c.feasible && !candidates[best].feasible)
+				|| (c.feasible == candidates[best].feasible && c.cost < candidates[best].cost))
+				best = i;
+		}
+		return best;
+	}
+
+} // namespace carnd
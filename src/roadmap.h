@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <chrono>
 #include <vector>
@@ -9,6 +11,15 @@
 #include <cmath>
 #include <random>
 #include "utils.h"
+#include "column.h"
+#include "mapfile.h"
+#include "waypoint_grid.h"
+#include "logger.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 namespace carnd
@@ -29,9 +40,168 @@ namespace carnd
 	// Waypoint list vector
 	struct waypoints_list
 	{
-		vector<double> x, y, s, dx, dy;
+		column<double> x, y, s, dx, dy;
+		// x, y, s and 0 of each waypoint side by side for the vectorized kernels
+		column<double> packed;
+
 		size_t size() const { return x.size(); }
 		waypoint_t operator[](int i) const { return {x[i], y[i], s[i], dx[i], dy[i]}; }
+
+		// Fill the packed waypoints from the columns
+		void pack();
+	};
+
+	void waypoints_list::pack()
+	{
+		packed.resize(4 * size());
+		for (size_t i = 0; i < size(); i++)
+		{
+			packed[4 * i] = x[i];
+			packed[4 * i + 1] = y[i];
+			packed[4 * i + 2] = s[i];
+			packed[4 * i + 3] = 0;
+		}
+	}
+
+	// Road segments between consecutive waypoints, precomputed for to_xy.
+	// Segment i starts at waypoint i with unit tangent t and unit normal n
+	// pointing to the right of the road, n = (ty, -tx).
+	struct segments_list
+	{
+		column<double> s;      // start s of each segment, plus max_s at the end
+		column<double> x, y;   // start point
+		column<double> tx, ty; // unit tangent
+		column<double> nx, ny; // unit normal
+		// x, y, tx, ty of each segment side by side, the vectorized kernels
+		// load a segment at once instead of gathering its columns
+		column<double> packed;
+
+		// s-bucket index: bucket[b] is the segment half a bucket before
+		// bucket b, so the segments overlapping it are bucket[b] ... bucket[b + 2]
+		// even with rounding at the boundaries, and bucket_next[b] is the
+		// start of the segment following bucket[b]
+		column<int> bucket;
+		column<double> bucket_next;
+		double bucket_scale = 0; // buckets per meter
+		// No bucket overlaps more than two segments
+		bool bucket_pairs = false;
+
+		size_t size() const { return x.size(); }
+
+		// Build the segments of a closed list of waypoints
+		void build(const waypoints_list &waypoints, double max_s);
+
+		// Segment containing s, with 0 <= s < max_s
+		int find(double s) const;
+
+		// Check if the buckets overlap two segments at most
+		void check_buckets();
+	};
+
+	// Build the segments of a closed list of waypoints
+	void segments_list::build(const waypoints_list &waypoints, double max_s)
+	{
+		const int n = (int)waypoints.size() - 1;
+
+		s.resize(n + 1);
+		x.resize(n);
+		y.resize(n);
+		tx.resize(n);
+		ty.resize(n);
+		nx.resize(n);
+		ny.resize(n);
+		packed.resize(4 * n);
+		bucket.clear();
+		bucket_next.clear();
+		bucket_pairs = false;
+		if (n < 1)
+			return;
+
+		for (int i = 0; i < n; i++)
+		{
+			const double heading = atan2(waypoints.y[i + 1] - waypoints.y[i],
+										 waypoints.x[i + 1] - waypoints.x[i]);
+			s[i] = waypoints.s[i];
+			x[i] = waypoints.x[i];
+			y[i] = waypoints.y[i];
+			tx[i] = cos(heading);
+			ty[i] = sin(heading);
+			nx[i] = ty[i];
+			ny[i] = -tx[i];
+			packed[4 * i] = x[i];
+			packed[4 * i + 1] = y[i];
+			packed[4 * i + 2] = tx[i];
+			packed[4 * i + 3] = ty[i];
+		}
+		s[n] = max_s;
+
+		// Buckets no longer than half the shortest segment, so a bucket and
+		// the half before it overlap two segments at most, within 2 to 16
+		// buckets per segment
+		double min_length = max_s;
+		for (int i = 0; i < n; i++)
+			min_length = min(min_length, s[i + 1] - s[i]);
+		const int buckets = (int)max(2.0 * n, min(16.0 * n, ceil(2 * max_s / max(min_length, 1e-9))));
+		bucket_scale = buckets / max_s;
+		bucket.resize(buckets + 2);
+		bucket_next.resize(buckets + 2);
+		int seg = 0;
+		for (int b = 0; b < buckets + 2; b++)
+		{
+			const double bucket_s = (b - 0.5) / bucket_scale;
+			while (seg < n - 1 && s[seg + 1] <= bucket_s)
+				seg++;
+			bucket[b] = seg;
+			// Past the end for the last segment, s wrapped to max_s stays on it
+			bucket_next[b] = seg < n - 1 ? s[seg + 1] : INF;
+		}
+		check_buckets();
+	}
+
+	// Segment containing s, with 0 <= s < max_s
+	int segments_list::find(double s_) const
+	{
+		const int b = min((int)(s_ * bucket_scale), (int)bucket.size() - 3);
+		if (bucket_pairs)
+			return bucket[b] + (s_ >= bucket_next[b]);
+		// Binary search for the last segment starting at or before s
+		auto first = s.begin() + bucket[b] + 1;
+		auto last = s.begin() + bucket[b + 2] + 1;
+		return upper_bound(first, last, s_) - s.begin() - 1;
+	}
+
+	// Check if the buckets overlap two segments at most
+	void segments_list::check_buckets()
+	{
+		// Read only, the buckets may be attached to a map file
+		const int *first = bucket.data();
+		bucket_pairs = bucket.size() >= 3;
+		for (size_t b = 0; b + 2 < bucket.size() && bucket_pairs; b++)
+			bucket_pairs = first[b + 2] <= first[b] + 1;
+	}
+
+	// Dense samples of the spline reference line every step meters of s,
+	// with the unit normal pointing to the right of the road
+	struct samples_list
+	{
+		column<double> x, y;   // reference point
+		column<double> nx, ny; // unit normal
+		double step = 0;       // distance between samples (m)
+		double inv_step = 0;
+
+		size_t size() const { return x.size(); }
+		bool empty() const { return x.empty(); }
+	};
+
+	// Cursor following a stream of queries along the map, such as the ego
+	// positions of consecutive ticks, to search from the last result
+	struct map_cursor
+	{
+		int waypoint = -1; // closest waypoint of the last query, -1 if none
+		double x = 0, y = 0; // last query position
+		double s = -1; // s of the last Newton projection, -1 if none
+
+		void reset() { waypoint = -1; s = -1; }
 	};
 
 	// Roadmap structure
@@ -41,63 +211,441 @@ namespace carnd
   		double max_s = 6945.554;
 
   		waypoints_list waypoints;
+  		// Spatial index over the waypoints
+  		waypoint_grid grid;
+  		// Segments between the waypoints
+  		segments_list segments;
+
+  		// Resolution of the spline map (m), or 0 to interpolate linearly
+  		// between the waypoints
+  		double resolution = 0;
+  		// Spline reference line through the waypoints
+  		spline_curve curve;
+  		bool curve_fitted = false;
+  		// Reference line sampled at the resolution
+  		samples_list samples;
+
+  		// A cursor query further than this from the last one searches globally
+  		double cursor_jump_distance = 50; //m
+  		// Max waypoints a cursor walks before searching globally
+  		int cursor_max_steps = 16;
 
-  		// Load map waypoints from a csv file
-  		void load(const string &filename);
+  		// Cartesian to frenet projection onto the chord between the waypoints,
+  		// or onto the spline reference line with Newton iterations
+  		enum class PROJECTION { CHORD = 0, NEWTON = 1 };
+  		PROJECTION projection = PROJECTION::CHORD;
+  		// Max Newton iterations, the projection stops once the step vanishes
+  		int newton_iterations = 8;
+
+  		// Memory mapped map file the tables are attached to, if any
+  		shared_ptr<mapped_file> file;
+
+  		// Load map waypoints from a csv file, or a binary map file. False if
+  		// the file has no waypoints or is an invalid map file, which leaves
+  		// the map as it was.
+  		bool load(const string &filename);
+  		// Save the waypoints and the precomputed tables to a binary map file
+  		bool save(const string &filename) const;
+
+  		// Set the resolution of the spline map and sample the reference
+  		// line, 0 to go back to linear interpolation
+  		void set_resolution(double resolution);
+  		// Set the frenet projection, fitting the reference line if needed
+  		void set_projection(PROJECTION projection);
+  		// Fit the spline reference line through the waypoints
+  		void fit_curve();
 
   		// Convert cartesian to frenet
   		sd_t to_frenet(double x, double y, double theta) const;
+  		// Convert cartesian to frenet searching from the cursor
+  		sd_t to_frenet(double x, double y, double theta, map_cursor &cursor) const;
   		// Convert frenet to cartesian
   		xy_t to_xy(double s, double d) const;
 
+  		// Batch conversions of n points stored as separate arrays, the
+  		// outputs are written to caller buffers of n elements
+  		void to_frenet(const double *x, const double *y, const double *theta, size_t n,
+  					   double *s, double *d) const;
+  		void to_frenet(const double *x, const double *y, const double *theta, size_t n,
+  					   double *s, double *d, map_cursor &cursor) const;
+  		void to_xy(const double *s, const double *d, size_t n, double *x, double *y) const;
+
   		// Closest waypoint to x,y
   		int closet_waypoint(double x, double y) const;
+  		// Closest waypoint to x,y by scanning all the waypoints
+  		int closet_waypoint_scan(double x, double y) const;
   		// Next waypoint looking forward in the direction of theta
   		int next_waypoint(double x, double y, double theta) const;
+
+  		// Closest waypoint to x,y searching from the cursor
+  		int closet_waypoint(double x, double y, map_cursor &cursor) const;
+  		// Next waypoint in the direction of theta searching from the cursor
+  		int next_waypoint(double x, double y, double theta, map_cursor &cursor) const;
+
+  	private:
+  		int next_from_closest(double x, double y, double theta, int closest) const;
+  		sd_t frenet_from_next(double x, double y, int next) const;
+  		bool load_binary(const string &filename);
+  		sd_t newton_projection(double x, double y, double s) const;
+  		void next_waypoint_kernel(const double *x, const double *y, const double *theta,
+  								  const int *closest, size_t n, int *next) const;
+  		void to_frenet_kernel(const double *x, const double *y, const int *prev, size_t n,
+  							  double *s, double *d) const;
+  		size_t to_xy_kernel(const double *s, const double *d, size_t n, double *x, double *y) const;
 	};
 
 	// RoadMap functions
 
-	void RoadMap::load(const string &filename)
+	bool RoadMap::load(const string &filename)
 	{
+		// Binary map files are used in place
+		if (is_map_file(filename))
+		{
+			if (!load_binary(filename))
+			{
+				LOG_ERROR("Invalid map file %s", filename.c_str());
+				return false;
+			}
+			return true;
+		}
+
 		// Waypoint map to read from file
 	    ifstream in_map_(filename, ifstream::in);
+	    if (!in_map_)
+	    {
+	    	LOG_ERROR("Cannot read the map file %s", filename.c_str());
+	    	return false;
+	    }
 
-	    waypoints.x.clear();
-	    waypoints.y.clear();
-	    waypoints.s.clear();
-	    waypoints.dx.clear();
-	    waypoints.dy.clear();
-
+	    // The tables are built aside, the current ones may be attached to a
+	    // mapped file and are kept if the file has no waypoints
+	    waypoints_list waypoints_;
 	    string line;
 	    while (getline(in_map_, line)) {
 	      istringstream iss(line);
 
 	      double x, y, s, dx, dy;
-	      iss >> x;
-  		  iss >> y;
-  		  iss >> s;
-  		  iss >> dx;
-  		  iss >> dy;
-
-	      waypoints.x.push_back(x);
-	      waypoints.y.push_back(y);
-	      waypoints.s.push_back(s);
-	      waypoints.dx.push_back(dx);
-	      waypoints.dy.push_back(dy);
+	      if (!(iss >> x >> y >> s >> dx >> dy))
+	        continue;
+
+	      waypoints_.x.push_back(x);
+	      waypoints_.y.push_back(y);
+	      waypoints_.s.push_back(s);
+	      waypoints_.dx.push_back(dx);
+	      waypoints_.dy.push_back(dy);
+	    }
+	    if (waypoints_.x.empty())
+	    {
+	    	LOG_ERROR("No waypoints in %s", filename.c_str());
+	    	return false;
 	    }
 
 	    // Add the last point
-	    waypoints.s.push_back(max_s);
-	    waypoints.x.push_back(waypoints.x[0]);
-	    waypoints.y.push_back(waypoints.y[0]);
-	    waypoints.dx.push_back(waypoints.dx[0]);
-	    waypoints.dy.push_back(waypoints.dy[0]);
+	    waypoints_.s.push_back(max_s);
+	    waypoints_.x.push_back(waypoints_.x[0]);
+	    waypoints_.y.push_back(waypoints_.y[0]);
+	    waypoints_.dx.push_back(waypoints_.dx[0]);
+	    waypoints_.dy.push_back(waypoints_.dy[0]);
+	    waypoints_.pack();
+
+	    // Index the waypoints for closest waypoint queries
+	    waypoint_grid grid_;
+	    grid_.build(waypoints_.x, waypoints_.y);
+	    // Precompute the segments for frenet to cartesian conversions
+	    segments_list segments_;
+	    segments_.build(waypoints_, max_s);
+
+	    // Swap the owned tables in, nothing points into the mapped file after
+	    waypoints = waypoints_;
+	    grid = grid_;
+	    segments = segments_;
+	    samples = samples_list();
+	    file.reset();
+	    curve_fitted = false;
+
+	    // Sample the spline map
+	    set_resolution(resolution);
+	    set_projection(projection);
+	    return true;
+	}
+
+	// Attach a column to a section of the mapped file
+	template <typename T>
+	bool attach_section(column<T> &col, const mapped_file &f, const map_header_t &header, int section)
+	{
+		const map_section_t &sec = header.section[section];
+		if (sec.offset % sizeof(T) != 0 || sec.offset > f.size
+			|| sec.count > (f.size - sec.offset) / sizeof(T))
+			return false;
+
+		col.attach((const T *)(f.data + sec.offset), sec.count);
+		return true;
+	}
+
+	// Load a binary map file, the tables are used in place from the mapping.
+	// The tables are attached to temporaries and checked against each other
+	// and the header first, the map is left as it was if the file is invalid.
+	bool RoadMap::load_binary(const string &filename)
+	{
+		shared_ptr<mapped_file> f = make_shared<mapped_file>();
+		if (!f->open(filename) || f->size < sizeof(map_header_t))
+			return false;
+
+		map_header_t header;
+		memcpy(&header, f->data, sizeof(header));
+		if (memcmp(header.magic, MAP_MAGIC, sizeof(MAP_MAGIC)) != 0
+			|| header.version != MAP_VERSION
+			|| header.endian != MAP_ENDIAN
+			|| header.sections != MAP_SECTIONS)
+			return false;
+
+		waypoints_list waypoints_;
+		waypoint_grid grid_;
+		segments_list segments_;
+		samples_list samples_;
+		bool ok = attach_section(waypoints_.x, *f, header, WAYPOINT_X)
+			&& attach_section(waypoints_.y, *f, header, WAYPOINT_Y)
+			&& attach_section(waypoints_.s, *f, header, WAYPOINT_S)
+			&& attach_section(waypoints_.dx, *f, header, WAYPOINT_DX)
+			&& attach_section(waypoints_.dy, *f, header, WAYPOINT_DY)
+			&& attach_section(waypoints_.packed, *f, header, WAYPOINT_PACKED)
+			&& attach_section(grid_.start, *f, header, GRID_START)
+			&& attach_section(grid_.items, *f, header, GRID_ITEMS)
+			&& attach_section(segments_.s, *f, header, SEGMENT_S)
+			&& attach_section(segments_.x, *f, header, SEGMENT_X)
+			&& attach_section(segments_.y, *f, header, SEGMENT_Y)
+			&& attach_section(segments_.tx, *f, header, SEGMENT_TX)
+			&& attach_section(segments_.ty, *f, header, SEGMENT_TY)
+			&& attach_section(segments_.nx, *f, header, SEGMENT_NX)
+			&& attach_section(segments_.ny, *f, header, SEGMENT_NY)
+			&& attach_section(segments_.packed, *f, header, SEGMENT_PACKED)
+			&& attach_section(segments_.bucket, *f, header, SEGMENT_BUCKET)
+			&& attach_section(segments_.bucket_next, *f, header, SEGMENT_BUCKET_NEXT)
+			&& attach_section(samples_.x, *f, header, SAMPLE_X)
+			&& attach_section(samples_.y, *f, header, SAMPLE_Y)
+			&& attach_section(samples_.nx, *f, header, SAMPLE_NX)
+			&& attach_section(samples_.ny, *f, header, SAMPLE_NY);
+		if (!ok)
+			return false;
+
+		// Waypoints, closed by a copy of the first one
+		const size_t n = waypoints_.size();
+		ok = n >= 3 && isfinite(header.max_s) && header.max_s > 0
+			&& waypoints_.y.size() == n && waypoints_.s.size() == n
+			&& waypoints_.dx.size() == n && waypoints_.dy.size() == n
+			&& waypoints_.packed.size() == 4 * n;
+
+		// Grid cells over the waypoints, read only as they are attached
+		const column<int> &start = grid_.start, &items = grid_.items;
+		ok = ok && header.grid_nx > 0 && header.grid_ny > 0 && header.grid_cell > 0
+			&& (uint64_t)header.grid_nx * header.grid_ny < INT32_MAX
+			&& start.size() == (size_t)header.grid_nx * header.grid_ny + 1
+			&& items.size() == n
+			&& start[0] == 0 && start[start.size() - 1] == (int)n;
+		for (size_t c = 1; ok && c < start.size(); c++)
+			ok = start[c] >= start[c - 1];
+		for (size_t i = 0; ok && i < n; i++)
+			ok = items[i] >= 0 && items[i] < (int)n;
+
+		// Segments between the waypoints and their buckets
+		const size_t n_segments = n - 1;
+		const column<int> &bucket = segments_.bucket;
+		const size_t buckets = bucket.size();
+		ok = ok && segments_.s.size() == n_segments + 1
+			&& segments_.x.size() == n_segments && segments_.y.size() == n_segments
+			&& segments_.tx.size() == n_segments && segments_.ty.size() == n_segments
+			&& segments_.nx.size() == n_segments && segments_.ny.size() == n_segments
+			&& segments_.packed.size() == 4 * n_segments
+			&& buckets >= 3 && segments_.bucket_next.size() == buckets
+			&& fabs(header.bucket_scale * header.max_s - (buckets - 2)) < 0.5;
+		for (size_t b = 0; ok && b < buckets; b++)
+			ok = bucket[b] >= 0 && bucket[b] < (int)n_segments && (b == 0 || bucket[b] >= bucket[b - 1]);
+
+		// Spline map samples over the whole track, or none
+		const size_t n_samples = samples_.size();
+		ok = ok && samples_.y.size() == n_samples
+			&& samples_.nx.size() == n_samples && samples_.ny.size() == n_samples;
+		if (header.resolution > 0)
+			ok = ok && n_samples >= 2 && header.sample_step > 0
+				&& fabs((n_samples - 1) * header.sample_step - header.max_s) < 1e-6 * header.max_s;
+		else
+			ok = ok && n_samples == 0;
+		if (!ok)
+			return false;
+
+		waypoints = waypoints_;
+		grid = grid_;
+		segments = segments_;
+		samples = samples_;
+		max_s = header.max_s;
+		grid.x0 = header.grid_x0;
+		grid.y0 = header.grid_y0;
+		grid.cell = header.grid_cell;
+		grid.nx = header.grid_nx;
+		grid.ny = header.grid_ny;
+		segments.bucket_scale = header.bucket_scale;
+		segments.check_buckets();
+		file = f;
+
+		// The spline map is sampled in the file, or sampled now if requested
+		if (header.resolution > 0)
+		{
+			resolution = header.resolution;
+			samples.step = header.sample_step;
+			samples.inv_step = 1 / samples.step;
+		}
+		else
+			set_resolution(resolution);
+		curve_fitted = false;
+		set_projection(projection);
+
+		return true;
+	}
+
+	// Write a column as a section of the map file
+	template <typename T>
+	void write_section(ofstream &out, const column<T> &col, map_header_t &header, int section)
+	{
+		// Pad to the alignment
+		const size_t offset = ((size_t)out.tellp() + map_alignment - 1) / map_alignment * map_alignment;
+		while ((size_t)out.tellp() < offset)
+			out.put(0);
+
+		header.section[section].offset = offset;
+		header.section[section].count = col.size();
+		out.write((const char *)col.data(), col.size() * sizeof(T));
+	}
+
+	// Save the waypoints and the precomputed tables to a binary map file
+	bool RoadMap::save(const string &filename) const
+	{
+		ofstream out(filename, ofstream::binary);
+		if (!out)
+			return false;
+
+		map_header_t header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, MAP_MAGIC, sizeof(MAP_MAGIC));
+		header.version = MAP_VERSION;
+		header.endian = MAP_ENDIAN;
+		header.sections = MAP_SECTIONS;
+		header.max_s = max_s;
+		header.grid_x0 = grid.x0;
+		header.grid_y0 = grid.y0;
+		header.grid_cell = grid.cell;
+		header.grid_nx = grid.nx;
+		header.grid_ny = grid.ny;
+		header.bucket_scale = segments.bucket_scale;
+		header.resolution = samples.empty() ? 0 : resolution;
+		header.sample_step = samples.step;
+
+		// Header first, rewritten once the sections are placed
+		out.write((const char *)&header, sizeof(header));
+
+		write_section(out, waypoints.x, header, WAYPOINT_X);
+		write_section(out, waypoints.y, header, WAYPOINT_Y);
+		write_section(out, waypoints.s, header, WAYPOINT_S);
+		write_section(out, waypoints.dx, header, WAYPOINT_DX);
+		write_section(out, waypoints.dy, header, WAYPOINT_DY);
+		write_section(out, waypoints.packed, header, WAYPOINT_PACKED);
+		write_section(out, grid.start, header, GRID_START);
+		write_section(out, grid.items, header, GRID_ITEMS);
+		write_section(out, segments.s, header, SEGMENT_S);
+		write_section(out, segments.x, header, SEGMENT_X);
+		write_section(out, segments.y, header, SEGMENT_Y);
+		write_section(out, segments.tx, header, SEGMENT_TX);
+		write_section(out, segments.ty, header, SEGMENT_TY);
+		write_section(out, segments.nx, header, SEGMENT_NX);
+		write_section(out, segments.ny, header, SEGMENT_NY);
+		write_section(out, segments.packed, header, SEGMENT_PACKED);
+		write_section(out, segments.bucket, header, SEGMENT_BUCKET);
+		write_section(out, segments.bucket_next, header, SEGMENT_BUCKET_NEXT);
+		write_section(out, samples.x, header, SAMPLE_X);
+		write_section(out, samples.y, header, SAMPLE_Y);
+		write_section(out, samples.nx, header, SAMPLE_NX);
+		write_section(out, samples.ny, header, SAMPLE_NY);
+
+		out.seekp(0);
+		out.write((const char *)&header, sizeof(header));
+
+		return (bool)out;
+	}
+
+	// Fit the spline reference line through the waypoints
+	void RoadMap::fit_curve()
+	{
+		// Fit the reference line with a few waypoints of padding on both
+		// sides, so it is smooth where the track wraps around
+		const int n = waypoints.size() - 1;
+		const int pad = min(n, 5);
+		vector<double> s, x, y;
+		for (int i = n - pad; i < n + n + pad; i++)
+		{
+			const int k = i % n;
+			s.push_back(waypoints.s[k] + (i / n - 1) * max_s);
+			x.push_back(waypoints.x[k]);
+			y.push_back(waypoints.y[k]);
+		}
+		curve.fit(s, x, y);
+		curve_fitted = true;
+	}
+
+	// Set the frenet projection, fitting the reference line if needed
+	void RoadMap::set_projection(PROJECTION projection_)
+	{
+		projection = projection_;
+		if (projection == PROJECTION::NEWTON && !curve_fitted && waypoints.size() > 2)
+			fit_curve();
+	}
+
+	// Set the resolution of the spline map and sample the reference line
+	void RoadMap::set_resolution(double resolution_)
+	{
+		resolution = resolution_;
+		samples = samples_list();
+		if (resolution <= 0)
+			return;
+
+		fit_curve();
+
+		// Sample the whole track, the last sample closes the loop
+		const int count = max((int)ceil(max_s / resolution), 1);
+		samples.step = max_s / count;
+		samples.inv_step = 1 / samples.step;
+		samples.x.resize(count + 1);
+		samples.y.resize(count + 1);
+		samples.nx.resize(count + 1);
+		samples.ny.resize(count + 1);
+		// The samples are sorted, the curve is evaluated in one walk over
+		// its intervals
+		vector<double> s_(count), tx(count), ty(count);
+		for (int i = 0; i < count; i++)
+			s_[i] = i * samples.step;
+		curve.eval(s_.data(), count, &samples.x[0], &samples.y[0], tx.data(), ty.data());
+		for (int i = 0; i < count; i++)
+		{
+			const double t = norm(tx[i], ty[i]);
+			samples.nx[i] = ty[i] / t;
+			samples.ny[i] = -tx[i] / t;
+		}
+		samples.x[count] = samples.x[0];
+		samples.y[count] = samples.y[0];
+		samples.nx[count] = samples.nx[0];
+		samples.ny[count] = samples.ny[0];
 	}
 
 
 	// Closest waypoint to x,y of car
 	int RoadMap::closet_waypoint(double x, double y) const
+	{
+		if (grid.empty())
+			return closet_waypoint_scan(x, y);
+
+		return grid.nearest(x, y, waypoints.x, waypoints.y);
+	}
+
+	// Closest waypoint to x,y of car by scanning all the waypoints
+	int RoadMap::closet_waypoint_scan(double x, double y) const
 	{
 
 		double closest_dist = numeric_limits<double>::max();
@@ -114,10 +662,71 @@ namespace carnd
 		return closest;
 	}
 
+	// Closest waypoint to x,y of car, walking along the waypoints from the
+	// cursor while they get closer. Far jumps fall back to the global search.
+	int RoadMap::closet_waypoint(double x, double y, map_cursor &cursor) const
+	{
+		// The last waypoint closes the loop and duplicates the first one
+		const int n = waypoints.size() - 1;
+
+		int closest = cursor.waypoint;
+
+		// Squared distances, the walk only compares them
+		auto distance2 = [x, y](double px, double py) { return (px - x) * (px - x) + (py - y) * (py - y); };
+
+		if (closest < 0 || closest >= n || n < 2
+			|| distance2(cursor.x, cursor.y) > cursor_jump_distance * cursor_jump_distance)
+		{
+			closest = closet_waypoint(x, y);
+		}
+		else
+		{
+			double closest_dist = distance2(waypoints.x[closest], waypoints.y[closest]);
+
+			int steps = 0;
+			for (int dir = 1; dir >= -1; dir -= 2)
+			{
+				while (steps <= cursor_max_steps)
+				{
+					const int i = (closest + dir + n) % n;
+					const double dist = distance2(waypoints.x[i], waypoints.y[i]);
+					if (dist >= closest_dist)
+						break;
+
+					closest_dist = dist;
+					closest = i;
+					steps++;
+				}
+			}
+
+			// Moved too far for a stream of queries, search globally
+			if (steps > cursor_max_steps)
+				closest = closet_waypoint(x, y);
+		}
+
+		cursor.waypoint = closest % n;
+		cursor.x = x;
+		cursor.y = y;
+
+		return closest;
+	}
+
 	// Nearest waypoint in the direction of theta of car
 	int RoadMap::next_waypoint(double x, double y, double theta) const
 	{
-		int next = closet_waypoint(x,y);
+		return next_from_closest(x, y, theta, closet_waypoint(x, y));
+	}
+
+	// Nearest waypoint in the direction of theta of car searching from the cursor
+	int RoadMap::next_waypoint(double x, double y, double theta, map_cursor &cursor) const
+	{
+		return next_from_closest(x, y, theta, closet_waypoint(x, y, cursor));
+	}
+
+	// Step to the following waypoint if the closest one is behind the car
+	int RoadMap::next_from_closest(double x, double y, double theta, int closest) const
+	{
+		int next = closest;
 		xy_t next_waypoint = {waypoints.x[next], waypoints.y[next]};
 
 		double heading = atan2(next_waypoint.y - y, next_waypoint.x - x);
@@ -135,8 +744,79 @@ namespace carnd
 	// Transform from Cartesian x,y coordinates to Frenet s,d coordinates
 	sd_t RoadMap::to_frenet(double x, double y, double theta) const
 	{
-		int next = next_waypoint(x, y, theta);
-		int prev = (next - 1) % waypoints.size();
+		sd_t sd = frenet_from_next(x, y, next_waypoint(x, y, theta));
+		if (projection == PROJECTION::NEWTON)
+			sd = newton_projection(x, y, sd.s);
+		return sd;
+	}
+
+	// Transform from Cartesian x,y coordinates to Frenet s,d coordinates
+	// searching from the cursor, amortized O(1) for a stream of close queries
+	sd_t RoadMap::to_frenet(double x, double y, double theta, map_cursor &cursor) const
+	{
+		if (projection == PROJECTION::NEWTON)
+		{
+			double s;
+			// Start from the last projection when close enough
+			if (cursor.s >= 0 && distance(x, y, cursor.x, cursor.y) <= cursor_jump_distance)
+				s = cursor.s;
+			else
+				s = frenet_from_next(x, y, next_waypoint(x, y, theta, cursor)).s;
+
+			sd_t sd = newton_projection(x, y, s);
+			cursor.x = x;
+			cursor.y = y;
+			cursor.s = sd.s;
+			return sd;
+		}
+
+		return frenet_from_next(x, y, next_waypoint(x, y, theta, cursor));
+	}
+
+	// Project x,y onto the reference line with Newton iterations from s,
+	// minimizing the distance |p - c(s)| where c(s) is the curve point at s
+	sd_t RoadMap::newton_projection(double x, double y, double s) const
+	{
+		for (int k = 0; k < newton_iterations; k++)
+		{
+			const double r_x = x - curve.x(s);
+			const double r_y = y - curve.y(s);
+			const double t_x = curve.dx(s);
+			const double t_y = curve.dy(s);
+
+			// f(s) = (p - c).c' = 0, f'(s) = (p - c).c'' - c'.c'
+			const double f = r_x * t_x + r_y * t_y;
+			const double df = r_x * curve.ddx(s) + r_y * curve.ddy(s) - (t_x * t_x + t_y * t_y);
+			if (df >= 0)
+				break;
+
+			// Keep the steps within the neighbourhood of the start
+			const double step = fmax(-10.0, fmin(10.0, f / df));
+			s -= step;
+			if (fabs(step) < 1e-9)
+				break;
+		}
+
+		// Wrap around the track
+		s = fmod(s, max_s);
+		if (s < 0)
+			s += max_s;
+
+		// d is positive to the right of the road, along the normal (ty, -tx)
+		const double t_x = curve.dx(s);
+		const double t_y = curve.dy(s);
+		const double d = ((x - curve.x(s)) * t_y - (y - curve.y(s)) * t_x) / norm(t_x, t_y);
+
+		return {s, d};
+	}
+
+	// Project x,y onto the segment ending at the next waypoint
+	sd_t RoadMap::frenet_from_next(double x, double y, int next) const
+	{
+		// The segment ending at the first waypoint is the one closing the loop
+		if (next == 0)
+			next = waypoints.size() - 1;
+		int prev = next - 1;
 
 		auto next_waypoint = waypoints[next];
 		auto prev_waypoint = waypoints[prev];
@@ -175,30 +855,398 @@ namespace carnd
 	// Transform from Frenet s,d coordinates to Cartesian x,y
 	xy_t RoadMap::to_xy(double s, double d) const
 	{
-		int prev_wp = -1;
+		// Wrap around the track
+		s = fmod(s, max_s);
+		if (s < 0)
+			s += max_s;
 
-		while(s > waypoints[prev_wp + 1].s && (prev_wp < (int)(waypoints.size() - 1) ))
+		// Interpolate the closest samples of the spline map
+		if (!samples.empty())
 		{
-			prev_wp++;
+			const double u = s * samples.inv_step;
+			const int i = min((int)u, (int)samples.size() - 2);
+			const double f = u - i;
+
+			double x = samples.x[i] + f * (samples.x[i + 1] - samples.x[i]);
+			double y = samples.y[i] + f * (samples.y[i + 1] - samples.y[i]);
+			x += d * (samples.nx[i] + f * (samples.nx[i + 1] - samples.nx[i]));
+			y += d * (samples.ny[i] + f * (samples.ny[i + 1] - samples.ny[i]));
+
+			return {x, y};
 		}
 
-		int wp2 = (prev_wp + 1) % waypoints.size();
+		const int seg = segments.find(s);
 
-		double heading = atan2(waypoints[wp2].y - waypoints[prev_wp].y, 
-							   waypoints[wp2].x - waypoints[prev_wp].x);
 		// the x,y,s along the segment
-		double seg_s = (s - waypoints[prev_wp].s);
-
-		double seg_x = waypoints[prev_wp].x + seg_s * cos(heading);
-		double seg_y = waypoints[prev_wp].y + seg_s * sin(heading);
+		double seg_s = (s - segments.s[seg]);
 
-		double perp_heading = heading - M_PI/2;
+		double seg_x = segments.x[seg] + seg_s * segments.tx[seg];
+		double seg_y = segments.y[seg] + seg_s * segments.ty[seg];
 
-		double x = seg_x + d * cos(perp_heading);
-		double y = seg_y + d * sin(perp_heading);
+		double x = seg_x + d * segments.nx[seg];
+		double y = seg_y + d * segments.ny[seg];
 
 		return {x, y};
 
 	}
 
+	// Batch transform from Cartesian to Frenet coordinates
+	void RoadMap::to_frenet(const double *x, const double *y, const double *theta, size_t n,
+							double *s, double *d) const
+	{
+		map_cursor cursor;
+		to_frenet(x, y, theta, n, s, d, cursor);
+	}
+
+	// Batch transform from Cartesian to Frenet coordinates following the points
+	// with the cursor. The closest waypoints are searched point by point, then
+	// the next waypoints and the projections are computed for a block of
+	// points at once.
+	void RoadMap::to_frenet(const double *x, const double *y, const double *theta, size_t n,
+							double *s, double *d, map_cursor &cursor) const
+	{
+		if (projection == PROJECTION::NEWTON)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				sd_t sd = to_frenet(x[i], y[i], theta[i], cursor);
+				s[i] = sd.s;
+				d[i] = sd.d;
+			}
+			return;
+		}
+
+		const int block = 64;
+		int closest[block];
+		int prev[block];
+
+		for (size_t i = 0; i < n; i += block)
+		{
+			const int m = min((size_t)block, n - i);
+			for (int k = 0; k < m; k++)
+				closest[k] = closet_waypoint(x[i + k], y[i + k], cursor);
+			next_waypoint_kernel(x + i, y + i, theta + i, closest, m, prev);
+			for (int k = 0; k < m; k++)
+			{
+				// The segment ending at the first waypoint is the one closing the loop
+				if (prev[k] == 0)
+					prev[k] = waypoints.size() - 1;
+				prev[k]--;
+			}
+			to_frenet_kernel(x + i, y + i, prev, m, s + i, d + i);
+		}
+	}
+
+	// next_from_closest of the points and their closest waypoints. The
+	// vectorized heading is a polynomial atan2 within 2e-8, the points
+	// whose angle is next to the pi/4 threshold are left to atan2.
+	void RoadMap::next_waypoint_kernel(const double *x, const double *y, const double *theta,
+									   const int *closest, size_t n, int *next) const
+	{
+		size_t i = 0;
+
+	#ifdef __AVX2__
+		const int n_waypoints = waypoints.size();
+		const size_t n_vector = waypoints.packed.size() == 4 * waypoints.size() ? n : 0;
+
+		const double *packed = waypoints.packed.data();
+		const __m256d sign = _mm256_set1_pd(-0.0);
+		const __m256d one = _mm256_set1_pd(1);
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d quarter = _mm256_set1_pd(pi() / 4);
+		const __m256d half = _mm256_set1_pd(pi() / 2);
+		const __m256d whole = _mm256_set1_pd(pi());
+		const __m256d last_quarter = _mm256_set1_pd(7 * pi() / 4);
+		const __m256d tolerance = _mm256_set1_pd(1e-7);
+		// Taylor series of atan(t) / t in t^2
+		static const double terms[] = { 1.0 / 15, 1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3, 1.0 };
+
+		for (; i + 4 <= n_vector; i += 4)
+		{
+			// Closest waypoints to columns
+			const __m256d r0 = _mm256_loadu_pd(packed + 4 * closest[i]);
+			const __m256d r1 = _mm256_loadu_pd(packed + 4 * closest[i + 1]);
+			const __m256d r2 = _mm256_loadu_pd(packed + 4 * closest[i + 2]);
+			const __m256d r3 = _mm256_loadu_pd(packed + 4 * closest[i + 3]);
+			const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+			const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+			const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+			const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+			const __m256d dx = _mm256_sub_pd(_mm256_permute2f128_pd(t0, t2, 0x20), _mm256_loadu_pd(x + i));
+			const __m256d dy = _mm256_sub_pd(_mm256_permute2f128_pd(t1, t3, 0x20), _mm256_loadu_pd(y + i));
+
+			// atan of the ratio in [0, 1], reduced to [0, tan(pi/8)] around pi/4
+			const __m256d ax = _mm256_andnot_pd(sign, dx);
+			const __m256d ay = _mm256_andnot_pd(sign, dy);
+			const __m256d high = _mm256_max_pd(ax, ay);
+			__m256d t = _mm256_div_pd(_mm256_min_pd(ax, ay), high);
+			const __m256d reduce = _mm256_cmp_pd(t, _mm256_set1_pd(0.41421356237309503), _CMP_GT_OQ);
+			t = _mm256_blendv_pd(t, _mm256_div_pd(_mm256_sub_pd(t, one), _mm256_add_pd(t, one)), reduce);
+			const __m256d t_2 = _mm256_mul_pd(t, t);
+			__m256d series = _mm256_set1_pd(terms[0]);
+			for (int k = 1; k < 8; k++)
+				series = _mm256_sub_pd(_mm256_set1_pd(terms[k]), _mm256_mul_pd(t_2, series));
+			__m256d heading = _mm256_add_pd(_mm256_and_pd(reduce, quarter), _mm256_mul_pd(t, series));
+
+			// Back to the quadrant of the heading
+			heading = _mm256_blendv_pd(heading, _mm256_sub_pd(half, heading), _mm256_cmp_pd(ay, ax, _CMP_GT_OQ));
+			heading = _mm256_blendv_pd(heading, _mm256_sub_pd(whole, heading), _mm256_cmp_pd(dx, zero, _CMP_LT_OQ));
+			heading = _mm256_xor_pd(heading, _mm256_and_pd(sign, dy));
+
+			const __m256d angle = _mm256_andnot_pd(sign, _mm256_sub_pd(_mm256_loadu_pd(theta + i), heading));
+			const __m256d step = _mm256_and_pd(_mm256_cmp_pd(angle, quarter, _CMP_GT_OQ),
+											   _mm256_cmp_pd(angle, last_quarter, _CMP_LT_OQ));
+			const __m256d exact = _mm256_or_pd(_mm256_cmp_pd(high, zero, _CMP_EQ_OQ), _mm256_or_pd(
+				_mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(angle, quarter)), tolerance, _CMP_LT_OQ),
+				_mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(angle, last_quarter)), tolerance, _CMP_LT_OQ)));
+
+			const int steps = _mm256_movemask_pd(step);
+			const int exacts = _mm256_movemask_pd(exact);
+			for (int k = 0; k < 4; k++)
+			{
+				const int j = closest[i + k] + ((steps >> k) & 1);
+				next[i + k] = j < n_waypoints ? j : 0;
+				if (exacts & (1 << k))
+					next[i + k] = next_from_closest(x[i + k], y[i + k], theta[i + k], closest[i + k]);
+			}
+		}
+	#elif defined(__SSE2__)
+		// Same kernel on 2 points, blends are masks without SSE4.1
+		const int n_waypoints = waypoints.size();
+		const size_t n_vector = waypoints.packed.size() == 4 * waypoints.size() ? n : 0;
+
+		const double *packed = waypoints.packed.data();
+		const __m128d sign = _mm_set1_pd(-0.0);
+		const __m128d one = _mm_set1_pd(1);
+		const __m128d zero = _mm_setzero_pd();
+		const __m128d quarter = _mm_set1_pd(pi() / 4);
+		const __m128d half = _mm_set1_pd(pi() / 2);
+		const __m128d whole = _mm_set1_pd(pi());
+		const __m128d last_quarter = _mm_set1_pd(7 * pi() / 4);
+		const __m128d tolerance = _mm_set1_pd(1e-7);
+		static const double terms[] = { 1.0 / 15, 1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3, 1.0 };
+		auto blend = [](__m128d a, __m128d b, __m128d mask) { return _mm_or_pd(_mm_andnot_pd(mask, a), _mm_and_pd(mask, b)); };
+
+		for (; i + 2 <= n_vector; i += 2)
+		{
+			const __m128d r0 = _mm_loadu_pd(packed + 4 * closest[i]);
+			const __m128d r1 = _mm_loadu_pd(packed + 4 * closest[i + 1]);
+			const __m128d dx = _mm_sub_pd(_mm_unpacklo_pd(r0, r1), _mm_loadu_pd(x + i));
+			const __m128d dy = _mm_sub_pd(_mm_unpackhi_pd(r0, r1), _mm_loadu_pd(y + i));
+
+			const __m128d ax = _mm_andnot_pd(sign, dx);
+			const __m128d ay = _mm_andnot_pd(sign, dy);
+			const __m128d high = _mm_max_pd(ax, ay);
+			__m128d t = _mm_div_pd(_mm_min_pd(ax, ay), high);
+			const __m128d reduce = _mm_cmpgt_pd(t, _mm_set1_pd(0.41421356237309503));
+			t = blend(t, _mm_div_pd(_mm_sub_pd(t, one), _mm_add_pd(t, one)), reduce);
+			const __m128d t_2 = _mm_mul_pd(t, t);
+			__m128d series = _mm_set1_pd(terms[0]);
+			for (int k = 1; k < 8; k++)
+				series = _mm_sub_pd(_mm_set1_pd(terms[k]), _mm_mul_pd(t_2, series));
+			__m128d heading = _mm_add_pd(_mm_and_pd(reduce, quarter), _mm_mul_pd(t, series));
+
+			heading = blend(heading, _mm_sub_pd(half, heading), _mm_cmpgt_pd(ay, ax));
+			heading = blend(heading, _mm_sub_pd(whole, heading), _mm_cmplt_pd(dx, zero));
+			heading = _mm_xor_pd(heading, _mm_and_pd(sign, dy));
+
+			const __m128d angle = _mm_andnot_pd(sign, _mm_sub_pd(_mm_loadu_pd(theta + i), heading));
+			const __m128d step = _mm_and_pd(_mm_cmpgt_pd(angle, quarter), _mm_cmplt_pd(angle, last_quarter));
+			const __m128d exact = _mm_or_pd(_mm_cmpeq_pd(high, zero), _mm_or_pd(
+				_mm_cmplt_pd(_mm_andnot_pd(sign, _mm_sub_pd(angle, quarter)), tolerance),
+				_mm_cmplt_pd(_mm_andnot_pd(sign, _mm_sub_pd(angle, last_quarter)), tolerance)));
+
+			const int steps = _mm_movemask_pd(step);
+			const int exacts = _mm_movemask_pd(exact);
+			for (int k = 0; k < 2; k++)
+			{
+				const int j = closest[i + k] + ((steps >> k) & 1);
+				next[i + k] = j < n_waypoints ? j : 0;
+				if (exacts & (1 << k))
+					next[i + k] = next_from_closest(x[i + k], y[i + k], theta[i + k], closest[i + k]);
+			}
+		}
+	#endif
+
+		for (; i < n; i++)
+			next[i] = next_from_closest(x[i], y[i], theta[i], closest[i]);
+	}
+
+	// Project the points onto the segments starting at the prev waypoints
+	void RoadMap::to_frenet_kernel(const double *x, const double *y, const int *prev, size_t n,
+								   double *s, double *d) const
+	{
+		size_t i = 0;
+
+	#ifdef __AVX2__
+		const double *wx = waypoints.x.data();
+		const double *wy = waypoints.y.data();
+		const double *ws = waypoints.s.data();
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d center_x = _mm256_set1_pd(1000);
+		const __m256d center_y = _mm256_set1_pd(2000);
+
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m128i p0 = _mm_loadu_si128((const __m128i *)(prev + i));
+			const __m128i p1 = _mm_add_epi32(p0, _mm_set1_epi32(1));
+
+			const __m256d x0 = _mm256_i32gather_pd(wx, p0, 8);
+			const __m256d y0 = _mm256_i32gather_pd(wy, p0, 8);
+			const __m256d n_x = _mm256_sub_pd(_mm256_i32gather_pd(wx, p1, 8), x0);
+			const __m256d n_y = _mm256_sub_pd(_mm256_i32gather_pd(wy, p1, 8), y0);
+			const __m256d x_x = _mm256_sub_pd(_mm256_loadu_pd(x + i), x0);
+			const __m256d x_y = _mm256_sub_pd(_mm256_loadu_pd(y + i), y0);
+
+			// find the projection of x onto n
+			const __m256d n_n = _mm256_add_pd(_mm256_mul_pd(n_x, n_x), _mm256_mul_pd(n_y, n_y));
+			const __m256d x_n = _mm256_add_pd(_mm256_mul_pd(x_x, n_x), _mm256_mul_pd(x_y, n_y));
+			const __m256d proj_norm = _mm256_div_pd(x_n, n_n);
+			const __m256d proj_x = _mm256_mul_pd(proj_norm, n_x);
+			const __m256d proj_y = _mm256_mul_pd(proj_norm, n_y);
+
+			const __m256d e_x = _mm256_sub_pd(x_x, proj_x);
+			const __m256d e_y = _mm256_sub_pd(x_y, proj_y);
+			__m256d frenet_d = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(e_x, e_x), _mm256_mul_pd(e_y, e_y)));
+
+			// d is negative when the point is closer than its projection to the center
+			const __m256d c_x = _mm256_sub_pd(center_x, x0);
+			const __m256d c_y = _mm256_sub_pd(center_y, y0);
+			const __m256d cp_x = _mm256_sub_pd(c_x, x_x);
+			const __m256d cp_y = _mm256_sub_pd(c_y, x_y);
+			const __m256d cr_x = _mm256_sub_pd(c_x, proj_x);
+			const __m256d cr_y = _mm256_sub_pd(c_y, proj_y);
+			const __m256d center_to_pos = _mm256_add_pd(_mm256_mul_pd(cp_x, cp_x), _mm256_mul_pd(cp_y, cp_y));
+			const __m256d center_to_ref = _mm256_add_pd(_mm256_mul_pd(cr_x, cr_x), _mm256_mul_pd(cr_y, cr_y));
+			const __m256d inside = _mm256_cmp_pd(center_to_pos, center_to_ref, _CMP_LE_OQ);
+			frenet_d = _mm256_blendv_pd(frenet_d, _mm256_sub_pd(zero, frenet_d), inside);
+
+			const __m256d proj = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(proj_x, proj_x), _mm256_mul_pd(proj_y, proj_y)));
+			const __m256d frenet_s = _mm256_add_pd(_mm256_i32gather_pd(ws, p0, 8), proj);
+
+			_mm256_storeu_pd(s + i, frenet_s);
+			_mm256_storeu_pd(d + i, frenet_d);
+		}
+	#endif
+
+		for (; i < n; i++)
+		{
+			sd_t sd = frenet_from_next(x[i], y[i], prev[i] + 1);
+			s[i] = sd.s;
+			d[i] = sd.d;
+		}
+	}
+
+	// Batch transform from Frenet to Cartesian coordinates
+	void RoadMap::to_xy(const double *s, const double *d, size_t n, double *x, double *y) const
+	{
+		// The spline map is a direct lookup
+		if (!samples.empty())
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				xy_t xy = to_xy(s[i], d[i]);
+				x[i] = xy.x;
+				y[i] = xy.y;
+			}
+			return;
+		}
+
+		size_t i = to_xy_kernel(s, d, n, x, y);
+
+		// Remaining points, wrapped only when they are off the track
+		for (; i < n; i++)
+		{
+			double s_ = s[i];
+			if (!(s_ >= 0 && s_ < max_s))
+			{
+				s_ = fmod(s_, max_s);
+				if (s_ < 0)
+					s_ += max_s;
+			}
+			const int seg = segments.find(s_);
+
+			const double seg_s = s_ - segments.s[seg];
+			x[i] = segments.x[seg] + seg_s * segments.tx[seg] + d[i] * segments.nx[seg];
+			y[i] = segments.y[seg] + seg_s * segments.ty[seg] + d[i] * segments.ny[seg];
+		}
+	}
+
+	// Vectorized to_xy, returns the number of points converted. The segments
+	// are found with scalar code from the buckets, then loaded whole from the
+	// packed table and transposed, gathers of each column are slower.
+	size_t RoadMap::to_xy_kernel(const double *s, const double *d, size_t n, double *x, double *y) const
+	{
+		size_t i = 0;
+
+	#ifdef __AVX2__
+		const int n_segments = segments.size();
+		if (n_segments < 1 || segments.packed.size() != 4 * segments.size())
+			return 0;
+
+		const double *seg_s = segments.s.data();
+		const double *packed = segments.packed.data();
+		const int *bucket = segments.bucket.data();
+		const double *bucket_next = segments.bucket_next.data();
+		const int last_bucket = (int)segments.bucket.size() - 3;
+		const bool pairs = segments.bucket_pairs;
+		const __m256d length = _mm256_set1_pd(max_s);
+		const __m256d inv_length = _mm256_set1_pd(1 / max_s);
+		const __m256d scale = _mm256_set1_pd(segments.bucket_scale);
+
+		for (; i + 4 <= n; i += 4)
+		{
+			// Wrap around the track
+			__m256d s_ = _mm256_loadu_pd(s + i);
+			s_ = _mm256_sub_pd(s_, _mm256_mul_pd(_mm256_floor_pd(_mm256_mul_pd(s_, inv_length)), length));
+
+			alignas(32) double wrapped[4];
+			alignas(16) int b[4];
+			_mm256_store_pd(wrapped, s_);
+			_mm_store_si128((__m128i *)b, _mm256_cvttpd_epi32(_mm256_mul_pd(s_, scale)));
+
+			// Last segment starting at or before s, one of the two segments
+			// of its bucket. Both loads depend on the bucket only, the search
+			// within the bucket is left to the maps with coarser buckets.
+			int seg[4];
+			alignas(32) double start[4];
+			for (int k = 0; k < 4; k++)
+			{
+				const int bk = min(b[k], last_bucket);
+				int j = bucket[bk] + (wrapped[k] >= bucket_next[bk]);
+				if (!pairs)
+					j = upper_bound(seg_s + bucket[bk] + 1, seg_s + bucket[bk + 2] + 1, wrapped[k]) - seg_s - 1;
+				seg[k] = j;
+				start[k] = seg_s[j];
+			}
+
+			// Segments to columns
+			const __m256d r0 = _mm256_loadu_pd(packed + 4 * seg[0]);
+			const __m256d r1 = _mm256_loadu_pd(packed + 4 * seg[1]);
+			const __m256d r2 = _mm256_loadu_pd(packed + 4 * seg[2]);
+			const __m256d r3 = _mm256_loadu_pd(packed + 4 * seg[3]);
+			const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+			const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+			const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+			const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+			const __m256d x0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+			const __m256d y0 = _mm256_permute2f128_pd(t1, t3, 0x20);
+			const __m256d tx = _mm256_permute2f128_pd(t0, t2, 0x31);
+			const __m256d ty = _mm256_permute2f128_pd(t1, t3, 0x31);
+
+			// the x,y,s along the segment
+			const __m256d ds = _mm256_sub_pd(s_, _mm256_load_pd(start));
+			const __m256d d_ = _mm256_loadu_pd(d + i);
+			const __m256d seg_x = _mm256_add_pd(x0, _mm256_mul_pd(ds, tx));
+			const __m256d seg_y = _mm256_add_pd(y0, _mm256_mul_pd(ds, ty));
+
+			// the normal is (ty, -tx)
+			_mm256_storeu_pd(x + i, _mm256_add_pd(seg_x, _mm256_mul_pd(d_, ty)));
+			_mm256_storeu_pd(y + i, _mm256_sub_pd(seg_y, _mm256_mul_pd(d_, tx)));
+		}
+	#endif
+
+		return i;
+	}
+
 } // namespace carnd
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cmath>
+#include "quintic.h"
+#include "workers.h"
+#include "predictor.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Data shared by the cost terms of a search
+	struct search_context_t
+	{
+		frenet_state_t start;
+		double t_start;     // s, time from now to the start state
+		double t_eval;      // s, costs are evaluated over [0, t_eval]
+		int n_steps;        // time steps checked over t_eval
+		double max_s;       // m, length of the road loop
+		double speed_limit; // m/s
+		double max_jerk;    // m/s^3
+		double lane_width;  // m
+		double safe_gap;    // m, s gap costing 1 in the collision margin
+		double min_gap;     // m, s gap below which a candidate collides
+		int start_lane;
+		const char *lane_feasible; // lanes with enough space to change into
+		int lane_count;
+		const Predictor *prediction; // rollouts of the cars from now
+		int model;                   // rollout checked for collisions
+		const int *cars_lane;        // lane of each car, < 0 off the road
+	};
+
+	// Weighted cost term, an infinite value rules the candidate out
+	struct cost_term_t
+	{
+		string name;
+		double weight;
+		function<double(const candidate_t &, const search_context_t &)> cost;
+	};
+
+	// Distance short of driving at the speed limit over t_eval, in [0, 1]
+	double cost_progress(const candidate_t &c, const search_context_t &ctx)
+	{
+		const double distance = c.at(ctx.t_eval).s - ctx.start.s;
+		return 1 - distance / (ctx.speed_limit * ctx.t_eval);
+	}
+
+	// Mean squared jerk relative to the jerk limit
+	double cost_comfort(const candidate_t &c, const search_context_t &ctx)
+	{
+		const double jerk = (c.s.jerk_cost(c.T) + c.d.jerk_cost(c.T)) / c.T;
+		return jerk / (ctx.max_jerk * ctx.max_jerk);
+	}
+
+	// Closest predicted car sharing the road width with the candidate, and
+	// the feasibility of the target lane from the lane analysis
+	double cost_collision(const candidate_t &c, const search_context_t &ctx)
+	{
+		const int target_lane = (int)floor(c.target_d / ctx.lane_width);
+		if (target_lane != ctx.start_lane
+			&& (target_lane < 0 || target_lane >= ctx.lane_count || !ctx.lane_feasible[target_lane]))
+			return INFINITY;
+
+		const Predictor &prediction = *ctx.prediction;
+		double closest = INFINITY;
+		for (int k = 0; k <= ctx.n_steps; k++)
+		{
+			const double t = ctx.t_eval * k / ctx.n_steps;
+			const frenet_state_t ego = c.at(t);
+
+			// Rollout rows around the time from now
+			int j;
+			float w;
+			prediction.sample(ctx.t_start + t, j, w);
+			const float *s0 = prediction.s_row(ctx.model, j), *s1 = prediction.s_row(ctx.model, j + 1);
+			const float *d0 = prediction.d_row(ctx.model, j), *d1 = prediction.d_row(ctx.model, j + 1);
+
+			for (size_t i = 0; i < prediction.size(); i++)
+			{
+				if (ctx.cars_lane[i] < 0)
+					continue;
+				const double d = d0[i] + w * (d1[i] - d0[i]);
+				if (fabs(d - ego.d) >= 0.75 * ctx.lane_width)
+					continue;
+				const double s = s0[i] + w * (s1[i] - s0[i]);
+				const double gap = fabs(remainder(s - ego.s, ctx.max_s));
+				closest = fmin(closest, gap);
+			}
+		}
+
+		if (closest < ctx.min_gap)
+			return INFINITY;
+		const double ratio = ctx.safe_gap / closest;
+		return ratio * ratio;
+	}
+
+	// Trajectory search over a grid of quintic candidates, scored with the
+	// weighted sum of the cost terms on a worker pool
+	struct TrajectorySearch
+	{
+		QuinticGenerator generator;
+		vector<cost_term_t> costs = {
+			{"progress", 1.0, cost_progress},
+			{"comfort", 0.5, cost_comfort},
+			{"collision", 1.0, cost_collision},
+		};
+		// Candidates per chunk of the parallel loop
+		int grain = 8;
+
+		// Score a candidate with the cost terms
+		void evaluate(candidate_t &candidate, const search_context_t &ctx) const;
+
+		// Generate and score the candidates, returns the best one
+		int run(const search_context_t &ctx,
+				const double *end_d, int n_d,
+				const double *end_v, int n_v,
+				const double *horizons, int n_T,
+				WorkerPool &workers);
+	};
+
+	void TrajectorySearch::evaluate(candidate_t &c, const search_context_t &ctx) const
+	{
+		c.feasible = generator.check(c);
+		c.cost = 0;
+		for (auto &term : costs)
+		{
+			const double cost = term.weight * term.cost(c, ctx);
+			if (isfinite(cost))
+				c.cost += cost;
+			else
+			{
+				c.feasible = false;
+				c.cost += 1e6;
+			}
+		}
+	}
+
+	int TrajectorySearch::run(const search_context_t &ctx,
+							  const double *end_d, int n_d,
+							  const double *end_v, int n_v,
+							  const double *horizons, int n_T,
+							  WorkerPool &workers)
+	{
+		generator.generate(ctx.start, end_d, n_d, end_v, n_v, horizons, n_T);
+
+		auto &candidates = generator.candidates;
+		workers.parallel_for(candidates.size(), grain, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+				evaluate(candidates[i], ctx);
+		});
+
+		return generator.best();
+	}
+
+} // namespace carnd
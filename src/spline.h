@@ -30,6 +30,7 @@
 #include <cstdio>
 #include <cassert>
 #include <vector>
+#include <array>
 #include <algorithm>
 
 
@@ -41,39 +42,49 @@ namespace
 namespace tk
 {
 
-// band matrix solver
-class band_matrix
+// solves the tridiagonal system with sub-diagonal lower[1..n-1], diagonal
+// diag[0..n-1] and super-diagonal upper[0..n-2] in place (Thomas algorithm),
+// diag is overwritten and rhs is replaced by the solution
+inline void thomas_solve(const double* lower, double* diag, const double* upper,
+                         double* rhs, int n)
 {
-private:
-    std::vector< std::vector<double> > m_upper;  // upper band
-    std::vector< std::vector<double> > m_lower;  // lower band
-public:
-    band_matrix() {};                             // constructor
-    band_matrix(int dim, int n_u, int n_l);       // constructor
-    ~band_matrix() {};                            // destructor
-    void resize(int dim, int n_u, int n_l);      // init with dim,n_u,n_l
-    int dim() const;                             // matrix dimension
-    int num_upper() const
-    {
-        return m_upper.size()-1;
+    for(int i=1; i<n; i++) {
+        assert(diag[i-1]!=0.0);
+        double w=lower[i]/diag[i-1];
+        diag[i]-=w*upper[i-1];
+        rhs[i]-=w*rhs[i-1];
     }
-    int num_lower() const
-    {
-        return m_lower.size()-1;
+    assert(diag[n-1]!=0.0);
+    rhs[n-1]/=diag[n-1];
+    for(int i=n-2; i>=0; i--) {
+        rhs[i]=(rhs[i]-upper[i]*rhs[i+1])/diag[i];
     }
-    // access operator
-    double & operator () (int i, int j);            // write
-    double   operator () (int i, int j) const;      // read
-    // we can store an additional diogonal (in m_lower)
-    double& saved_diag(int i);
-    double  saved_diag(int i) const;
-    void lu_decompose();
-    std::vector<double> r_solve(const std::vector<double>& b) const;
-    std::vector<double> l_solve(const std::vector<double>& b) const;
-    std::vector<double> lu_solve(const std::vector<double>& b,
-                                 bool is_lu_decomposed=false);
+}
 
-};
+
+// evaluates the cubic a*h^3 + b*h^2 + c*h + y0, h=x-x0, and its
+// derivatives for n points, the loops have no branches so they vectorize
+inline void eval_cubic(const double* x, int n, double x0, double y0,
+                       double a, double b, double c,
+                       double* y, double* dy, double* ddy)
+{
+    for(int i=0; i<n; i++) {
+        double h=x[i]-x0;
+        y[i]=((a*h + b)*h + c)*h + y0;
+    }
+    if(dy!=NULL) {
+        for(int i=0; i<n; i++) {
+            double h=x[i]-x0;
+            dy[i]=(3.0*a*h + 2.0*b)*h + c;
+        }
+    }
+    if(ddy!=NULL) {
+        for(int i=0; i<n; i++) {
+            double h=x[i]-x0;
+            ddy[i]=6.0*a*h + 2.0*b;
+        }
+    }
+}
 
 
 // spline interpolation
@@ -94,6 +105,7 @@ private:
     bd_type m_left, m_right;
     double  m_left_value, m_right_value;
     bool    m_force_linear_extrapolation;
+    std::vector<double> m_work;             // tridiagonal solver scratch
 
 public:
     // set default boundary condition to be zero curvature at both ends
@@ -111,158 +123,66 @@ public:
     void set_points(const std::vector<double>& x,
                     const std::vector<double>& y, bool cubic_spline=true);
     double operator() (double x) const;
+    double deriv(int order, double x) const;
+    // evaluates the n sorted points x[] into y[], and optionally the first
+    // and second derivatives into dy[] and ddy[]
+    void eval(const double* x, int n, double* y,
+              double* dy=NULL, double* ddy=NULL) const;
 };
 
 
-
-// ---------------------------------------------------------------------
-// implementation part, which could be separated into a cpp file
-// ---------------------------------------------------------------------
-
-
-// band_matrix implementation
-// -------------------------
-
-band_matrix::band_matrix(int dim, int n_u, int n_l)
+// cubic spline interpolation of up to N points without heap allocation,
+// same boundary conditions and results as spline
+template <int N>
+class small_spline
 {
-    resize(dim, n_u, n_l);
-}
-void band_matrix::resize(int dim, int n_u, int n_l)
-{
-    assert(dim>0);
-    assert(n_u>=0);
-    assert(n_l>=0);
-    m_upper.resize(n_u+1);
-    m_lower.resize(n_l+1);
-    for(size_t i=0; i<m_upper.size(); i++) {
-        m_upper[i].resize(dim);
-    }
-    for(size_t i=0; i<m_lower.size(); i++) {
-        m_lower[i].resize(dim);
-    }
-}
-int band_matrix::dim() const
-{
-    if(m_upper.size()>0) {
-        return m_upper[0].size();
-    } else {
-        return 0;
-    }
-}
-
+private:
+    // interleaved knot data
+    // f(x) = a*(x-x_i)^3 + b*(x-x_i)^2 + c*(x-x_i) + y_i
+    struct knot {
+        double x, y, a, b, c;
+    };
+    std::array<knot, N> m_knots;
+    int     m_n;
+    double  m_b0, m_c0;                     // for left extrapol
+    spline::bd_type m_left, m_right;
+    double  m_left_value, m_right_value;
+    bool    m_force_linear_extrapolation;
 
-// defines the new operator (), so that we can access the elements
-// by A(i,j), index going from i=0,...,dim()-1
-double & band_matrix::operator () (int i, int j)
-{
-    int k=j-i;       // what band is the entry
-    assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
-    assert( (-num_lower()<=k) && (k<=num_upper()) );
-    // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
-}
-double band_matrix::operator () (int i, int j) const
-{
-    int k=j-i;       // what band is the entry
-    assert( (i>=0) && (i<dim()) && (j>=0) && (j<dim()) );
-    assert( (-num_lower()<=k) && (k<=num_upper()) );
-    // k=0 -> diogonal, k<0 lower left part, k>0 upper right part
-    if(k>=0)   return m_upper[k][i];
-    else	    return m_lower[-k][i];
-}
-// second diag (used in LU decomposition), saved in m_lower
-double band_matrix::saved_diag(int i) const
-{
-    assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
-}
-double & band_matrix::saved_diag(int i)
-{
-    assert( (i>=0) && (i<dim()) );
-    return m_lower[0][i];
-}
+    int find(double x) const;
 
-// LR-Decomposition of a band matrix
-void band_matrix::lu_decompose()
-{
-    int  i_max,j_max;
-    int  j_min;
-    double x;
-
-    // preconditioning
-    // normalize column i so that a_ii=1
-    for(int i=0; i<this->dim(); i++) {
-        assert(this->operator()(i,i)!=0.0);
-        this->saved_diag(i)=1.0/this->operator()(i,i);
-        j_min=std::max(0,i-this->num_lower());
-        j_max=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=j_min; j<=j_max; j++) {
-            this->operator()(i,j) *= this->saved_diag(i);
-        }
-        this->operator()(i,i)=1.0;          // prevents rounding errors
+public:
+    // set default boundary condition to be zero curvature at both ends
+    small_spline(): m_n(0), m_left(spline::second_deriv), m_right(spline::second_deriv),
+        m_left_value(0.0), m_right_value(0.0),
+        m_force_linear_extrapolation(false)
+    {
+        ;
     }
 
-    // Gauss LR-Decomposition
-    for(int k=0; k<this->dim(); k++) {
-        i_max=std::min(this->dim()-1,k+this->num_lower());  // num_lower not a mistake!
-        for(int i=k+1; i<=i_max; i++) {
-            assert(this->operator()(k,k)!=0.0);
-            x=-this->operator()(i,k)/this->operator()(k,k);
-            this->operator()(i,k)=-x;                         // assembly part of L
-            j_max=std::min(this->dim()-1,k+this->num_upper());
-            for(int j=k+1; j<=j_max; j++) {
-                // assembly part of R
-                this->operator()(i,j)=this->operator()(i,j)+x*this->operator()(k,j);
-            }
-        }
-    }
-}
-// solves Ly=b
-std::vector<double> band_matrix::l_solve(const std::vector<double>& b) const
-{
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
-    int j_start;
-    double sum;
-    for(int i=0; i<this->dim(); i++) {
-        sum=0;
-        j_start=std::max(0,i-this->num_lower());
-        for(int j=j_start; j<i; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=(b[i]*this->saved_diag(i)) - sum;
-    }
-    return x;
-}
-// solves Rx=y
-std::vector<double> band_matrix::r_solve(const std::vector<double>& b) const
-{
-    assert( this->dim()==(int)b.size() );
-    std::vector<double> x(this->dim());
-    int j_stop;
-    double sum;
-    for(int i=this->dim()-1; i>=0; i--) {
-        sum=0;
-        j_stop=std::min(this->dim()-1,i+this->num_upper());
-        for(int j=i+1; j<=j_stop; j++) sum += this->operator()(i,j)*x[j];
-        x[i]=( b[i] - sum ) / this->operator()(i,i);
+    // optional, but if called it has to come be before set_points()
+    void set_boundary(spline::bd_type left, double left_value,
+                      spline::bd_type right, double right_value,
+                      bool force_linear_extrapolation=false);
+    // n points with 2 < n <= N
+    void set_points(const double* x, const double* y, int n);
+    int size() const
+    {
+        return m_n;
     }
-    return x;
-}
+    double operator() (double x) const;
+    double deriv(int order, double x) const;
+    // evaluates the n sorted points x[] into y[], and optionally the first
+    // and second derivatives into dy[] and ddy[]
+    void eval(const double* x, int n, double* y,
+              double* dy=NULL, double* ddy=NULL) const;
+};
 
-std::vector<double> band_matrix::lu_solve(const std::vector<double>& b,
-        bool is_lu_decomposed)
-{
-    assert( this->dim()==(int)b.size() );
-    std::vector<double>  x,y;
-    if(is_lu_decomposed==false) {
-        this->lu_decompose();
-    }
-    y=this->l_solve(b);
-    x=this->r_solve(y);
-    return x;
-}
 
 
+// ---------------------------------------------------------------------
+// implementation part, which could be separated into a cpp file
+// ---------------------------------------------------------------------
 
 
 // spline implementation
@@ -295,49 +215,53 @@ void spline::set_points(const std::vector<double>& x,
     }
 
     if(cubic_spline==true) { // cubic spline interpolation
-        // setting up the matrix and right hand side of the equation system
-        // for the parameters b[]
-        band_matrix A(n,1,1);
-        std::vector<double>  rhs(n);
+        // setting up the tridiagonal matrix and right hand side of the
+        // equation system for the parameters b[], the right hand side is
+        // stored in m_b and solved in place
+        m_work.resize(3*n);
+        double* lower=&m_work[0];
+        double* diag=&m_work[n];
+        double* upper=&m_work[2*n];
+        m_b.resize(n);
         for(int i=1; i<n-1; i++) {
-            A(i,i-1)=1.0/3.0*(x[i]-x[i-1]);
-            A(i,i)=2.0/3.0*(x[i+1]-x[i-1]);
-            A(i,i+1)=1.0/3.0*(x[i+1]-x[i]);
-            rhs[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+            lower[i]=1.0/3.0*(x[i]-x[i-1]);
+            diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+            upper[i]=1.0/3.0*(x[i+1]-x[i]);
+            m_b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
         }
         // boundary conditions
         if(m_left == spline::second_deriv) {
             // 2*b[0] = f''
-            A(0,0)=2.0;
-            A(0,1)=0.0;
-            rhs[0]=m_left_value;
+            diag[0]=2.0;
+            upper[0]=0.0;
+            m_b[0]=m_left_value;
         } else if(m_left == spline::first_deriv) {
             // c[0] = f', needs to be re-expressed in terms of b:
             // (2b[0]+b[1])(x[1]-x[0]) = 3 ((y[1]-y[0])/(x[1]-x[0]) - f')
-            A(0,0)=2.0*(x[1]-x[0]);
-            A(0,1)=1.0*(x[1]-x[0]);
-            rhs[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+            diag[0]=2.0*(x[1]-x[0]);
+            upper[0]=1.0*(x[1]-x[0]);
+            m_b[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
         } else {
             assert(false);
         }
         if(m_right == spline::second_deriv) {
             // 2*b[n-1] = f''
-            A(n-1,n-1)=2.0;
-            A(n-1,n-2)=0.0;
-            rhs[n-1]=m_right_value;
+            diag[n-1]=2.0;
+            lower[n-1]=0.0;
+            m_b[n-1]=m_right_value;
         } else if(m_right == spline::first_deriv) {
             // c[n-1] = f', needs to be re-expressed in terms of b:
             // (b[n-2]+2b[n-1])(x[n-1]-x[n-2])
             // = 3 (f' - (y[n-1]-y[n-2])/(x[n-1]-x[n-2]))
-            A(n-1,n-1)=2.0*(x[n-1]-x[n-2]);
-            A(n-1,n-2)=1.0*(x[n-1]-x[n-2]);
-            rhs[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+            diag[n-1]=2.0*(x[n-1]-x[n-2]);
+            lower[n-1]=1.0*(x[n-1]-x[n-2]);
+            m_b[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
         } else {
             assert(false);
         }
 
         // solve the equation system to obtain the parameters b[]
-        m_b=A.lu_solve(rhs);
+        thomas_solve(lower, diag, upper, &m_b[0], n);
 
         // calculate parameters a[] and c[] based on b[]
         m_a.resize(n);
@@ -395,6 +319,279 @@ double spline::operator() (double x) const
     return interpol;
 }
 
+double spline::deriv(int order, double x) const
+{
+    assert(order>0);
+
+    size_t n=m_x.size();
+    // find the closest point m_x[idx] < x, idx=0 even if x<m_x[0]
+    std::vector<double>::const_iterator it;
+    it=std::lower_bound(m_x.begin(),m_x.end(),x);
+    int idx=std::max( int(it-m_x.begin())-1, 0);
+
+    double h=x-m_x[idx];
+    double interpol;
+    if(x<m_x[0]) {
+        // extrapolation to the left
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b0*h + m_c0;
+            break;
+        case 2:
+            interpol=2.0*m_b0;
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else if(x>m_x[n-1]) {
+        // extrapolation to the right
+        switch(order) {
+        case 1:
+            interpol=2.0*m_b[n-1]*h + m_c[n-1];
+            break;
+        case 2:
+            interpol=2.0*m_b[n-1];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    } else {
+        // interpolation
+        switch(order) {
+        case 1:
+            interpol=(3.0*m_a[idx]*h + 2.0*m_b[idx])*h + m_c[idx];
+            break;
+        case 2:
+            interpol=6.0*m_a[idx]*h + 2.0*m_b[idx];
+            break;
+        case 3:
+            interpol=6.0*m_a[idx];
+            break;
+        default:
+            interpol=0.0;
+            break;
+        }
+    }
+    return interpol;
+}
+
+
+// evaluates sorted points, walking the intervals with a cursor and
+// evaluating each run of points in the same interval at once
+void spline::eval(const double* x, int n, double* y, double* dy, double* ddy) const
+{
+    const int m=m_x.size();
+    int i=0;
+
+    // extrapolation to the left
+    int run=0;
+    while(run<n && x[run]<m_x[0]) run++;
+    eval_cubic(x, run, m_x[0], m_y[0], 0.0, m_b0, m_c0, y, dy, ddy);
+    i=run;
+
+    // interpolation, points in (x_idx, x_idx+1] use interval idx, and the
+    // extrapolation to the right is the last interval since a[m-1]=0
+    int idx=0;
+    while(i<n) {
+        while(idx+1<m && m_x[idx+1]<x[i]) idx++;
+        int end=i+1;
+        if(idx+1<m) {
+            while(end<n && x[end]<=m_x[idx+1]) end++;
+        } else {
+            end=n;
+        }
+        eval_cubic(x+i, end-i, m_x[idx], m_y[idx], m_a[idx], m_b[idx], m_c[idx],
+                   y+i, dy ? dy+i : NULL, ddy ? ddy+i : NULL);
+        i=end;
+    }
+}
+
+
+// small_spline implementation
+// -----------------------
+
+template <int N>
+void small_spline<N>::set_boundary(spline::bd_type left, double left_value,
+                                   spline::bd_type right, double right_value,
+                                   bool force_linear_extrapolation)
+{
+    assert(m_n==0);                 // set_points() must not have happened yet
+    m_left=left;
+    m_right=right;
+    m_left_value=left_value;
+    m_right_value=right_value;
+    m_force_linear_extrapolation=force_linear_extrapolation;
+}
+
+template <int N>
+void small_spline<N>::set_points(const double* x, const double* y, int n)
+{
+    assert(n>2 && n<=N);
+    m_n=n;
+    for(int i=0; i<n; i++) {
+        m_knots[i].x=x[i];
+        m_knots[i].y=y[i];
+    }
+    for(int i=0; i<n-1; i++) {
+        assert(x[i]<x[i+1]);
+    }
+
+    // setting up the tridiagonal matrix and right hand side of the
+    // equation system for the parameters b[], as in spline::set_points()
+    std::array<double, N> lower, diag, upper, b;
+    for(int i=1; i<n-1; i++) {
+        lower[i]=1.0/3.0*(x[i]-x[i-1]);
+        diag[i]=2.0/3.0*(x[i+1]-x[i-1]);
+        upper[i]=1.0/3.0*(x[i+1]-x[i]);
+        b[i]=(y[i+1]-y[i])/(x[i+1]-x[i]) - (y[i]-y[i-1])/(x[i]-x[i-1]);
+    }
+    // boundary conditions
+    if(m_left == spline::second_deriv) {
+        diag[0]=2.0;
+        upper[0]=0.0;
+        b[0]=m_left_value;
+    } else if(m_left == spline::first_deriv) {
+        diag[0]=2.0*(x[1]-x[0]);
+        upper[0]=1.0*(x[1]-x[0]);
+        b[0]=3.0*((y[1]-y[0])/(x[1]-x[0])-m_left_value);
+    } else {
+        assert(false);
+    }
+    if(m_right == spline::second_deriv) {
+        diag[n-1]=2.0;
+        lower[n-1]=0.0;
+        b[n-1]=m_right_value;
+    } else if(m_right == spline::first_deriv) {
+        diag[n-1]=2.0*(x[n-1]-x[n-2]);
+        lower[n-1]=1.0*(x[n-1]-x[n-2]);
+        b[n-1]=3.0*(m_right_value-(y[n-1]-y[n-2])/(x[n-1]-x[n-2]));
+    } else {
+        assert(false);
+    }
+
+    // solve the equation system to obtain the parameters b[]
+    thomas_solve(&lower[0], &diag[0], &upper[0], &b[0], n);
+
+    // calculate parameters a[] and c[] based on b[]
+    for(int i=0; i<n; i++) {
+        m_knots[i].b=b[i];
+    }
+    for(int i=0; i<n-1; i++) {
+        m_knots[i].a=1.0/3.0*(b[i+1]-b[i])/(x[i+1]-x[i]);
+        m_knots[i].c=(y[i+1]-y[i])/(x[i+1]-x[i])
+                     - 1.0/3.0*(2.0*b[i]+b[i+1])*(x[i+1]-x[i]);
+    }
+
+    // for left extrapolation coefficients
+    m_b0 = (m_force_linear_extrapolation==false) ? m_knots[0].b : 0.0;
+    m_c0 = m_knots[0].c;
+
+    // for the right extrapolation coefficients
+    // f_{n-1}(x) = b*(x-x_{n-1})^2 + c*(x-x_{n-1}) + y_{n-1}
+    double h=x[n-1]-x[n-2];
+    // b[n-1] is determined by the boundary condition
+    m_knots[n-1].a=0.0;
+    m_knots[n-1].c=3.0*m_knots[n-2].a*h*h+2.0*m_knots[n-2].b*h+m_knots[n-2].c;
+    if(m_force_linear_extrapolation==true)
+        m_knots[n-1].b=0.0;
+}
+
+// find the closest point x_idx < x, idx=0 even if x<x_0
+template <int N>
+int small_spline<N>::find(double x) const
+{
+    int idx=0;
+    while(idx+1<m_n && m_knots[idx+1].x<x) {
+        idx++;
+    }
+    return idx;
+}
+
+template <int N>
+double small_spline<N>::operator() (double x) const
+{
+    const int n=m_n;
+    const int idx=find(x);
+    const knot& k=m_knots[idx];
+
+    double h=x-k.x;
+    double interpol;
+    if(x<m_knots[0].x) {
+        // extrapolation to the left
+        interpol=(m_b0*h + m_c0)*h + m_knots[0].y;
+    } else if(x>m_knots[n-1].x) {
+        // extrapolation to the right
+        h=x-m_knots[n-1].x;
+        interpol=(m_knots[n-1].b*h + m_knots[n-1].c)*h + m_knots[n-1].y;
+    } else {
+        // interpolation
+        interpol=((k.a*h + k.b)*h + k.c)*h + k.y;
+    }
+    return interpol;
+}
+
+// evaluates sorted points, walking the intervals with a cursor and
+// evaluating each run of points in the same interval at once
+template <int N>
+void small_spline<N>::eval(const double* x, int n, double* y, double* dy, double* ddy) const
+{
+    const int m=m_n;
+    int i=0;
+
+    // extrapolation to the left
+    int run=0;
+    while(run<n && x[run]<m_knots[0].x) run++;
+    eval_cubic(x, run, m_knots[0].x, m_knots[0].y, 0.0, m_b0, m_c0, y, dy, ddy);
+    i=run;
+
+    // interpolation, points in (x_idx, x_idx+1] use interval idx, and the
+    // extrapolation to the right is the last interval since a[m-1]=0
+    int idx=0;
+    while(i<n) {
+        while(idx+1<m && m_knots[idx+1].x<x[i]) idx++;
+        int end=i+1;
+        if(idx+1<m) {
+            while(end<n && x[end]<=m_knots[idx+1].x) end++;
+        } else {
+            end=n;
+        }
+        const knot& k=m_knots[idx];
+        eval_cubic(x+i, end-i, k.x, k.y, k.a, k.b, k.c,
+                   y+i, dy ? dy+i : NULL, ddy ? ddy+i : NULL);
+        i=end;
+    }
+}
+
+template <int N>
+double small_spline<N>::deriv(int order, double x) const
+{
+    assert(order>0);
+
+    const int n=m_n;
+    const int idx=find(x);
+    const knot& k=m_knots[idx];
+
+    double h=x-k.x;
+    double interpol;
+    if(x<m_knots[0].x) {
+        // extrapolation to the left
+        interpol = order==1 ? 2.0*m_b0*h + m_c0 : order==2 ? 2.0*m_b0 : 0.0;
+    } else if(x>m_knots[n-1].x) {
+        // extrapolation to the right
+        const knot& r=m_knots[n-1];
+        h=x-r.x;
+        interpol = order==1 ? 2.0*r.b*h + r.c : order==2 ? 2.0*r.b : 0.0;
+    } else {
+        // interpolation
+        interpol = order==1 ? (3.0*k.a*h + 2.0*k.b)*h + k.c :
+                   order==2 ? 6.0*k.a*h + 2.0*k.b :
+                   order==3 ? 6.0*k.a : 0.0;
+    }
+    return interpol;
+}
+
 
 } // namespace tk
 
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "utils.h"
+#include "planner.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Socket.IO event frame 42["event", payload], as views into the frame
+	struct frame_t
+	{
+		const char *event = nullptr;   // name without its quotes
+		size_t event_length = 0;
+		const char *payload = nullptr; // empty for no payload or null
+		size_t payload_length = 0;
+
+		bool is(const char *name) const
+		{
+			return strlen(name) == event_length && memcmp(event, name, event_length) == 0;
+		}
+	};
+
+	// Decode the event frame in the length bytes of data, which need not end
+	// with a 0. False if it is not an event frame or it is malformed.
+	bool decode_frame(const char *data, size_t length, frame_t &frame);
+
+	// Single pass parser of the simulator messages, the values are written
+	// straight into the reused ego_t buffers without building a DOM
+	class TelemetryParser
+	{
+	public:
+		// Parse the telemetry object at [begin, end) into ego, false if it is
+		// malformed or a field is missing
+		bool parse(const char *begin, const char *end, ego_t &ego);
+
+		// Position of the last error in the parsed text
+		const char *error() const { return error_; }
+
+	private:
+		enum FIELD
+		{
+			FIELD_X = 1 << 0,
+			FIELD_Y = 1 << 1,
+			FIELD_S = 1 << 2,
+			FIELD_D = 1 << 3,
+			FIELD_YAW = 1 << 4,
+			FIELD_SPEED = 1 << 5,
+			FIELD_PATH_X = 1 << 6,
+			FIELD_PATH_Y = 1 << 7,
+			FIELD_END_S = 1 << 8,
+			FIELD_END_D = 1 << 9,
+			FIELD_CARS = 1 << 10,
+			FIELD_ALL = (1 << 11) - 1
+		};
+
+		bool fail(const char *p) { error_ = p; return false; }
+
+		void skip_space();
+		bool expect(char c);
+		// String without its quotes, the escapes are left as they are
+		bool quoted(const char *&begin, const char *&end);
+		bool number(double &value);
+#if LDBL_MANT_DIG == 64
+		// Powers of 10 exact in extended precision
+		static long double extended_powers(int e)
+		{
+			static const long double powers[] = {
+				1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+				1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L,
+				1e26L, 1e27L };
+			return powers[e];
+		}
+#endif
+		bool numbers(vector<double> &values);
+		bool cars(cars_list &cars);
+		// Skip any json value
+		bool skip_value(int depth = 0);
+
+		const char *p_ = nullptr;
+		const char *end_ = nullptr;
+		const char *error_ = nullptr;
+	};
+
+	bool decode_frame(const char *data, size_t length, frame_t &frame)
+	{
+		auto space = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; };
+		const char *p = data;
+		const char *end = data + length;
+
+		// The 4 is a message, the 2 an event
+		if (length < 4 || p[0] != '4' || p[1] != '2' || p[2] != '[')
+			return false;
+		p += 3;
+
+		// Closing bracket of the event
+		while (end > p && space(end[-1]))
+			end--;
+		if (end == p || *--end != ']')
+			return false;
+
+		while (p < end && space(*p))
+			p++;
+		if (p == end || *p != '"')
+			return false;
+		frame.event = ++p;
+		while (p < end && *p != '"')
+			p += (*p == '\\') ? 2 : 1;
+		if (p >= end)
+			return false;
+		frame.event_length = p++ - frame.event;
+
+		while (p < end && space(*p))
+			p++;
+		frame.payload = p;
+		frame.payload_length = 0;
+		if (p == end)
+			return true;
+		if (*p != ',')
+			return false;
+		for (p++; p < end && space(*p); p++)
+			;
+		const char *payload_end = end;
+		while (payload_end > p && space(payload_end[-1]))
+			payload_end--;
+		frame.payload = p;
+		if (payload_end - p != 4 || memcmp(p, "null", 4) != 0)
+			frame.payload_length = payload_end - p;
+		return true;
+	}
+
+	void TelemetryParser::skip_space()
+	{
+		while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+			p_++;
+	}
+
+	bool TelemetryParser::expect(char c)
+	{
+		skip_space();
+		if (p_ >= end_ || *p_ != c)
+			return fail(p_);
+		p_++;
+		return true;
+	}
+
+	bool TelemetryParser::quoted(const char *&begin, const char *&end)
+	{
+		if (!expect('"'))
+			return false;
+		begin = p_;
+		while (p_ < end_ && *p_ != '"')
+			p_ += (*p_ == '\\') ? 2 : 1;
+		if (p_ >= end_)
+			return fail(begin);
+		end = p_++;
+		return true;
+	}
+
+	bool TelemetryParser::number(double &value)
+	{
+		skip_space();
+		const char *start = p_;
+
+		// Decimal digits in a 64 bit mantissa, the value is exact when the
+		// mantissa and the power of 10 are both exact doubles
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		const bool negative = p_ < end_ && *p_ == '-';
+		if (negative)
+			p_++;
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		for (; p_ < end_ && *p_ >= '0' && *p_ <= '9'; p_++, digits++)
+			mantissa = mantissa * 10 + (*p_ - '0');
+		if (p_ < end_ && *p_ == '.')
+			for (p_++; p_ < end_ && *p_ >= '0' && *p_ <= '9'; p_++, digits++, exponent--)
+				mantissa = mantissa * 10 + (*p_ - '0');
+		if (p_ < end_ && (*p_ == 'e' || *p_ == 'E'))
+		{
+			p_++;
+			const bool negative_exponent = p_ < end_ && *p_ == '-';
+			if (p_ < end_ && (*p_ == '-' || *p_ == '+'))
+				p_++;
+			int e = 0;
+			for (; p_ < end_ && *p_ >= '0' && *p_ <= '9'; p_++)
+				e = min(e * 10 + (*p_ - '0'), 10000);
+			exponent += negative_exponent ? -e : e;
+		}
+		if (digits == 0)
+			return fail(start);
+
+		if (digits <= 19 && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+		{
+			value = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+			if (negative)
+				value = -value;
+			return true;
+		}
+
+#if LDBL_MANT_DIG == 64
+		// Longer mantissas are exact in the x87 extended precision, its
+		// single rounding gives the double unless it lands next to a half
+		// way point between two doubles
+		if (digits <= 19 && exponent >= -27 && exponent <= 27)
+		{
+			long double extended = mantissa;
+			extended = exponent < 0 ? extended / extended_powers(-exponent) : extended * extended_powers(exponent);
+			int e;
+			const uint64_t bits = (uint64_t)ldexpl(frexpl(extended, &e), 64) & 0x7ff;
+			if (bits < 0x3ff || bits > 0x401)
+			{
+				value = negative ? -(double)extended : (double)extended;
+				return true;
+			}
+		}
+#endif
+
+		// Rounded by strtod otherwise
+		char text[64];
+		const size_t length = p_ - start;
+		if (length >= sizeof(text))
+			return fail(start);
+		memcpy(text, start, length);
+		text[length] = 0;
+		value = strtod(text, nullptr);
+		return true;
+	}
+
+	bool TelemetryParser::numbers(vector<double> &values)
+	{
+		values.clear();
+		if (!expect('['))
+			return false;
+		skip_space();
+		if (p_ < end_ && *p_ == ']')
+		{
+			p_++;
+			return true;
+		}
+		while (true)
+		{
+			double value;
+			if (!number(value))
+				return false;
+			values.push_back(value);
+			skip_space();
+			if (p_ < end_ && *p_ == ',')
+				p_++;
+			else
+				return expect(']');
+		}
+	}
+
+	bool TelemetryParser::cars(cars_list &cars)
+	{
+		cars.clear();
+		if (!expect('['))
+			return false;
+		skip_space();
+		if (p_ < end_ && *p_ == ']')
+		{
+			p_++;
+			return true;
+		}
+		while (true)
+		{
+			// [id, x, y, vx, vy, s, d]
+			double id;
+			car_t car;
+			if (!expect('[') || !number(id)
+				|| !expect(',') || !number(car.x) || !expect(',') || !number(car.y)
+				|| !expect(',') || !number(car.vx) || !expect(',') || !number(car.vy)
+				|| !expect(',') || !number(car.s) || !expect(',') || !number(car.d)
+				|| !expect(']'))
+				return false;
+			car.id = (int)id;
+			cars.push_back(car);
+
+			skip_space();
+			if (p_ < end_ && *p_ == ',')
+				p_++;
+			else
+				return expect(']');
+		}
+	}
+
+	bool TelemetryParser::skip_value(int depth)
+	{
+		skip_space();
+		if (p_ >= end_ || depth > 64)
+			return fail(p_);
+
+		const char *begin, *end;
+		double value;
+		switch (*p_)
+		{
+		case '"':
+			return quoted(begin, end);
+		case '{':
+		case '[':
+		{
+			const char close = *p_ == '{' ? '}' : ']';
+			p_++;
+			skip_space();
+			if (p_ < end_ && *p_ == close)
+			{
+				p_++;
+				return true;
+			}
+			while (true)
+			{
+				if (close == '}' && (!quoted(begin, end) || !expect(':')))
+					return false;
+				if (!skip_value(depth + 1))
+					return false;
+				skip_space();
+				if (p_ < end_ && *p_ == ',')
+					p_++;
+				else
+					return expect(close);
+			}
+		}
+		case 't':
+		case 'n':
+			if (end_ - p_ < 4)
+				return fail(p_);
+			p_ += 4;
+			return true;
+		case 'f':
+			if (end_ - p_ < 5)
+				return fail(p_);
+			p_ += 5;
+			return true;
+		default:
+			return number(value);
+		}
+	}
+
+	bool TelemetryParser::parse(const char *begin, const char *end, ego_t &ego)
+	{
+		p_ = begin;
+		end_ = end;
+		error_ = nullptr;
+
+		if (!expect('{'))
+			return false;
+		skip_space();
+		if (p_ < end_ && *p_ == '}')
+			return fail(p_);
+
+		int fields = 0;
+		while (true)
+		{
+			const char *key, *key_end;
+			if (!quoted(key, key_end) || !expect(':'))
+				return false;
+
+			const size_t length = key_end - key;
+			auto is = [&](const char *name) { return strlen(name) == length && memcmp(key, name, length) == 0; };
+
+			bool ok;
+			if (is("x")) { ok = number(ego.x); fields |= FIELD_X; }
+			else if (is("y")) { ok = number(ego.y); fields |= FIELD_Y; }
+			else if (is("s")) { ok = number(ego.s); fields |= FIELD_S; }
+			else if (is("d")) { ok = number(ego.d); fields |= FIELD_D; }
+			else if (is("yaw")) { ok = number(ego.yaw); fields |= FIELD_YAW; }
+			else if (is("speed")) { ok = number(ego.v); fields |= FIELD_SPEED; }
+			else if (is("previous_path_x")) { ok = numbers(ego.previous_path.x); fields |= FIELD_PATH_X; }
+			else if (is("previous_path_y")) { ok = numbers(ego.previous_path.y); fields |= FIELD_PATH_Y; }
+			else if (is("end_path_s")) { ok = number(ego.end_path.s); fields |= FIELD_END_S; }
+			else if (is("end_path_d")) { ok = number(ego.end_path.d); fields |= FIELD_END_D; }
+			else if (is("sensor_fusion")) { ok = cars(ego.cars); fields |= FIELD_CARS; }
+			else ok = skip_value();
+			if (!ok)
+				return false;
+
+			skip_space();
+			if (p_ < end_ && *p_ == ',')
+				p_++;
+			else if (!expect('}'))
+				return false;
+			else
+				break;
+		}
+
+		if (fields != FIELD_ALL || ego.previous_path.x.size() != ego.previous_path.y.size())
+			return fail(p_);
+
+		// Simulator units to the planner units
+		ego.yaw = deg2rad(ego.yaw);
+		ego.v = mph2mps(ego.v);
+		return true;
+	}
+
+} // namespace carnd
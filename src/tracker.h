@@ -0,0 +1,238 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Filtered state of a sensor fusion car
+	struct track_t
+	{
+		int id;
+		double s, v, a;   // m, m/s, m/s^2 along the road
+		double d, d_dot;  // m, m/s across the road
+		double last_seen; // s, tracker time of the last measurement
+		int updates;      // measurements filtered so far
+	};
+
+	// Tracks of the sensor fusion cars kept by id over the ticks, with fixed
+	// gain filters: alpha on s, alpha beta on the speed for the acceleration
+	// and alpha beta on d for its rate. The tracks live in a fixed pool of
+	// slots found through an open addressing hash table, nothing is
+	// allocated after construction.
+	class Tracker
+	{
+	public:
+		// Filter gains
+		double alpha_s = 0.8;
+		double alpha_v = 0.5;
+		double beta_v = 0.1;
+		double alpha_d = 0.5;
+		double beta_d = 0.1;
+		// Tracks not seen for longer are expired
+		double max_age = 1.0; // s
+		// The rates divide the residuals by the step, at least this long so
+		// that close measurements do not blow them up
+		double min_dt = 0.02; // s, a simulator step
+		// Bound of the acceleration estimate
+		double max_accel = 10.0; // m/s^2
+
+		explicit Tracker(size_t capacity = 4096);
+
+		// Filter the measurements of n cars taken elapsed seconds after the
+		// previous ones, s wrapping around at max_s. The cars beyond the
+		// capacity are not tracked.
+		void update(const int *id, const double *s, const double *d, const double *speed,
+					size_t n, double elapsed, double max_s);
+
+		// Track of an id, nullptr if it is not tracked
+		const track_t *find(int id) const;
+		// Track of the i-th car of the last update, nullptr if not tracked
+		const track_t *at(size_t i) const
+		{
+			return i >= car_slots_.size() || car_slots_[i] < 0 ? nullptr : &slots_[car_slots_[i]];
+		}
+
+		size_t size() const { return active_.size(); }
+		size_t capacity() const { return slots_.size(); }
+		// Measurements left out because the pool was full
+		size_t dropped() const { return dropped_; }
+		// s, time since the first update
+		double time() const { return time_; }
+
+		void clear();
+
+	private:
+		static uint32_t hash(int id) { return (uint32_t)id * 2654435761u; }
+
+		// Table position of an id, or of the empty entry where it goes
+		size_t position(int id) const;
+		// Slot of a new track, -1 if the pool is full
+		int insert(int id);
+		void erase(int slot);
+
+		vector<track_t> slots_;
+		vector<int> free_;      // unused slots
+		vector<int> active_;    // used slots
+		vector<int> table_;     // slot of each entry, -1 if empty
+		vector<int> car_slots_; // slot of each car of the last update
+		size_t mask_;
+		size_t dropped_ = 0;
+		double time_ = 0;
+	};
+
+	Tracker::Tracker(size_t capacity)
+	{
+		// Table at most half full
+		size_t size = 1;
+		while (size < 2 * capacity)
+			size <<= 1;
+		mask_ = size - 1;
+
+		slots_.resize(capacity);
+		table_.resize(size);
+		free_.reserve(capacity);
+		active_.reserve(capacity);
+		car_slots_.reserve(capacity);
+		clear();
+	}
+
+	void Tracker::clear()
+	{
+		fill(table_.begin(), table_.end(), -1);
+		free_.clear();
+		for (int i = (int)slots_.size() - 1; i >= 0; i--)
+			free_.push_back(i);
+		active_.clear();
+		car_slots_.clear();
+		dropped_ = 0;
+		time_ = 0;
+	}
+
+	size_t Tracker::position(int id) const
+	{
+		size_t k = hash(id) & mask_;
+		while (table_[k] >= 0 && slots_[table_[k]].id != id)
+			k = (k + 1) & mask_;
+		return k;
+	}
+
+	const track_t *Tracker::find(int id) const
+	{
+		const int slot = table_[position(id)];
+		return slot < 0 ? nullptr : &slots_[slot];
+	}
+
+	int Tracker::insert(int id)
+	{
+		if (free_.empty())
+			return -1;
+		const int slot = free_.back();
+		free_.pop_back();
+		table_[position(id)] = slot;
+		active_.push_back(slot);
+		slots_[slot].id = id;
+		return slot;
+	}
+
+	void Tracker::erase(int slot)
+	{
+		// Shift the following entries of the probe sequence back into the hole
+		size_t hole = position(slots_[slot].id);
+		size_t k = hole;
+		while (true)
+		{
+			k = (k + 1) & mask_;
+			if (table_[k] < 0)
+				break;
+			const size_t home = hash(slots_[table_[k]].id) & mask_;
+			// Move the entry unless its home lies cyclically in (hole, k]
+			if (((k - home) & mask_) >= ((k - hole) & mask_))
+			{
+				table_[hole] = table_[k];
+				hole = k;
+			}
+		}
+		table_[hole] = -1;
+		free_.push_back(slot);
+	}
+
+	void Tracker::update(const int *id, const double *s, const double *d, const double *speed,
+						 size_t n, double elapsed, double max_s)
+	{
+		const double dt = max(elapsed, 0.0);
+		time_ += dt;
+
+		car_slots_.resize(min(n, slots_.size()));
+		for (size_t i = 0; i < car_slots_.size(); i++)
+		{
+			int slot = table_[position(id[i])];
+			if (slot < 0)
+			{
+				// New track at the measured state
+				slot = insert(id[i]);
+				car_slots_[i] = slot;
+				if (slot < 0)
+				{
+					dropped_++;
+					continue;
+				}
+				slots_[slot] = {id[i], s[i], speed[i], 0, d[i], 0, time_, 1};
+				continue;
+			}
+			car_slots_[i] = slot;
+
+			track_t &t = slots_[slot];
+			t.last_seen = time_;
+			// Same measurements as the last tick
+			if (dt <= 0)
+				continue;
+
+			// Predict at constant acceleration, then correct with the residuals
+			const double s_pred = t.s + (t.v + 0.5 * t.a * dt) * dt;
+			const double v_pred = t.v + t.a * dt;
+			const double d_pred = t.d + t.d_dot * dt;
+
+			double r_s = s[i] - s_pred;
+			if (r_s > 0.5 * max_s)
+				r_s -= max_s;
+			else if (r_s < -0.5 * max_s)
+				r_s += max_s;
+			const double r_v = speed[i] - v_pred;
+			const double r_d = d[i] - d_pred;
+
+			t.s = s_pred + alpha_s * r_s;
+			if (t.s >= max_s)
+				t.s -= max_s;
+			else if (t.s < 0)
+				t.s += max_s;
+			const double rate_dt = max(dt, min_dt);
+			t.v = v_pred + alpha_v * r_v;
+			t.a = max(-max_accel, min(max_accel, t.a + beta_v * r_v / rate_dt));
+			t.d = d_pred + alpha_d * r_d;
+			t.d_dot += beta_d * r_d / rate_dt;
+			t.updates++;
+		}
+		dropped_ += n - car_slots_.size();
+
+		// Expire the stale tracks
+		for (size_t k = 0; k < active_.size();)
+		{
+			const int slot = active_[k];
+			if (time_ - slots_[slot].last_seen > max_age)
+			{
+				erase(slot);
+				active_[k] = active_.back();
+				active_.pop_back();
+			}
+			else
+				k++;
+		}
+	}
+
+} // namespace carnd
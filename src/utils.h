@@ -52,18 +52,31 @@ namespace carnd
 
 	// interpolated curve
     struct spline_curve {
-    	void fit(vector<double> s, vector<double> x, vector<double> y);
+    	void fit(const vector<double> &s, const vector<double> &x, const vector<double> &y);
     	inline double x(double s) const { return s_x_(s); }
     	inline double y(double s) const { return s_y_(s); }
+    	// first derivatives
+    	inline double dx(double s) const { return s_x_.deriv(1, s); }
+    	inline double dy(double s) const { return s_y_.deriv(1, s); }
+    	// second derivatives
+    	inline double ddx(double s) const { return s_x_.deriv(2, s); }
+    	inline double ddy(double s) const { return s_y_.deriv(2, s); }
+    	// points and first derivatives at the n sorted s[]
+    	void eval(const double *s, int n, double *x, double *y, double *dx, double *dy) const;
     private:
     	tk::spline s_x_;
     	tk::spline s_y_;
     };
 
-    void spline_curve::fit(vector<double> s, vector<double> x, vector<double> y) {
+    void spline_curve::fit(const vector<double> &s, const vector<double> &x, const vector<double> &y) {
     	// TODO: Check loops where s is not monotonic
     	s_x_.set_points(s, x);
     	s_y_.set_points(s, y);
     }
+
+    void spline_curve::eval(const double *s, int n, double *x, double *y, double *dx, double *dy) const {
+    	s_x_.eval(s, n, x, dx);
+    	s_y_.eval(s, n, y, dy);
+    }
 	
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "utils.h"
+#include "column.h"
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Uniform grid over the waypoints for nearest neighbour queries.
+	// Cells are stored in a compressed layout: the waypoints of cell c are
+	// items[start[c]] ... items[start[c + 1] - 1], sorted by index.
+	struct waypoint_grid
+	{
+		double x0 = 0, y0 = 0;    // grid origin
+		double cell = 1;          // cell size (m)
+		int nx = 0, ny = 0;       // number of cells in x and y
+		column<int> start;        // first item of each cell, size nx*ny + 1
+		column<int> items;        // waypoint indices grouped by cell
+
+		bool empty() const { return items.empty(); }
+
+		// Build the grid over the waypoints x, y
+		void build(const column<double> &x, const column<double> &y);
+
+		// Index of the closest waypoint to (px, py), ties go to the lowest index
+		int nearest(double px, double py, const column<double> &x, const column<double> &y) const;
+
+	private:
+		int cell_x(double px) const { return (int)floor((px - x0) / cell); }
+		int cell_y(double py) const { return (int)floor((py - y0) / cell); }
+	};
+
+	// Build the grid over the waypoints x, y
+	void waypoint_grid::build(const column<double> &x, const column<double> &y)
+	{
+		const int n = x.size();
+
+		start.clear();
+		items.clear();
+		nx = ny = 0;
+		if (n == 0)
+			return;
+
+		double x1 = x[0], y1 = y[0];
+		x0 = x[0];
+		y0 = y[0];
+		for (int i = 1; i < n; i++)
+		{
+			x0 = min(x0, x[i]);
+			y0 = min(y0, y[i]);
+			x1 = max(x1, x[i]);
+			y1 = max(y1, y[i]);
+		}
+
+		// Aim for about one waypoint per cell, but never below the mean
+		// waypoint spacing since the waypoints lie on a curve
+		double length = 0;
+		for (int i = 1; i < n; i++)
+			length += distance(x[i - 1], y[i - 1], x[i], y[i]);
+		const double spacing = length / max(n - 1, 1);
+		const double area = max(x1 - x0, 1.0) * max(y1 - y0, 1.0);
+		cell = max(sqrt(area / n), spacing);
+		if (!(cell > 0))
+			cell = 1;
+
+		nx = cell_x(x1) + 1;
+		ny = cell_y(y1) + 1;
+
+		// Counting sort of the waypoints into their cells
+		start.assign(nx * ny + 1, 0);
+		for (int i = 0; i < n; i++)
+			start[cell_y(y[i]) * nx + cell_x(x[i]) + 1]++;
+		for (int c = 0; c < nx * ny; c++)
+			start[c + 1] += start[c];
+
+		items.resize(n);
+		vector<int> fill(start.begin(), start.end() - 1);
+		for (int i = 0; i < n; i++)
+			items[fill[cell_y(y[i]) * nx + cell_x(x[i])]++] = i;
+	}
+
+	// Index of the closest waypoint to (px, py), ties go to the lowest index.
+	// Rings of cells around the query cell are searched until no point
+	// outside the visited rings can be closer than the best one found.
+	int waypoint_grid::nearest(double px, double py, const column<double> &x, const column<double> &y) const
+	{
+		double best_dist = numeric_limits<double>::max();
+		int best = 0;
+
+		const int cx = cell_x(px);
+		const int cy = cell_y(py);
+
+		// First ring that touches the grid and last ring needed to cover it
+		const int r_first = max(max(-cx, cx - (nx - 1)), max(-cy, cy - (ny - 1)));
+		const int r_last = max(max(cx, nx - 1 - cx), max(cy, ny - 1 - cy));
+
+		for (int r = max(r_first, 0); r <= r_last; r++)
+		{
+			// Points outside of ring r - 1 are at least (r - 1) * cell away
+			if (r > 0 && best_dist < (r - 1) * cell)
+				break;
+
+			const int j_min = max(cy - r, 0), j_max = min(cy + r, ny - 1);
+			for (int j = j_min; j <= j_max; j++)
+			{
+				const bool edge_row = (j == cy - r || j == cy + r);
+				const int step = edge_row ? 1 : 2 * r;
+				for (int i = cx - r; i <= cx + r; i += max(step, 1))
+				{
+					if (i < 0 || i >= nx)
+						continue;
+
+					const int c = j * nx + i;
+					for (int k = start[c]; k < start[c + 1]; k++)
+					{
+						const int w = items[k];
+						const double dist = distance(px, py, x[w], y[w]);
+						if (dist < best_dist || (dist == best_dist && w < best))
+						{
+							best_dist = dist;
+							best = w;
+						}
+					}
+				}
+			}
+		}
+
+		return best;
+	}
+
+} // namespace carnd
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+
+namespace carnd
+{
+	using namespace std;
+
+	// Fixed pool of worker threads for parallel loops, the calling thread
+	// takes part in every loop
+	class WorkerPool
+	{
+	public:
+		WorkerPool() {}
+		WorkerPool(const WorkerPool &) = delete;
+		WorkerPool &operator=(const WorkerPool &) = delete;
+		~WorkerPool() { stop(); }
+
+		// Start n worker threads, one per core besides the caller if n < 0
+		void start(int n = -1);
+		// Stop and join the worker threads
+		void stop();
+
+		// Threads running a loop, the caller included
+		int size() const { return threads_.size() + 1; }
+
+		// Run f(begin, end) over [0, n) in chunks of grain items
+		template <typename F>
+		void parallel_for(int n, int grain, const F &f);
+
+	private:
+		template <typename F>
+		static void invoke(const void *f, int begin, int end) { (*(const F *)f)(begin, end); }
+
+		// Worker thread main, waiting for the loops after the given generation
+		void worker(unsigned generation);
+		// Take chunks of the current loop until it is done
+		void work();
+
+		vector<thread> threads_;
+		mutex mutex_;
+		condition_variable wake_, done_;
+		bool stop_ = false;
+		unsigned generation_ = 0;
+		int busy_ = 0;
+
+		// Current loop
+		void (*call_)(const void *, int, int) = nullptr;
+		const void *f_ = nullptr;
+		int n_ = 0;
+		int grain_ = 1;
+		atomic<int> next_{0};
+	};
+
+	void WorkerPool::start(int n)
+	{
+		stop();
+		if (n < 0)
+			n = max(0, (int)thread::hardware_concurrency() - 1);
+
+		stop_ = false;
+		threads_.reserve(n);
+		for (int i = 0; i < n; i++)
+			threads_.emplace_back(&WorkerPool::worker, this, generation_);
+	}
+
+	void WorkerPool::stop()
+	{
+		{
+			lock_guard<mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+		for (auto &t : threads_)
+			t.join();
+		threads_.clear();
+	}
+
+	template <typename F>
+	void WorkerPool::parallel_for(int n, int grain, const F &f)
+	{
+		grain = max(grain, 1);
+		// Not worth waking the workers
+		if (threads_.empty() || n <= grain)
+		{
+			if (n > 0)
+				f(0, n);
+			return;
+		}
+
+		{
+			lock_guard<mutex> lock(mutex_);
+			call_ = &invoke<F>;
+			f_ = &f;
+			n_ = n;
+			grain_ = grain;
+			next_ = 0;
+			busy_ = threads_.size();
+			generation_++;
+		}
+		wake_.notify_all();
+
+		work();
+
+		unique_lock<mutex> lock(mutex_);
+		done_.wait(lock, [this] { return busy_ == 0; });
+	}
+
+	void WorkerPool::worker(unsigned generation)
+	{
+		while (true)
+		{
+			{
+				unique_lock<mutex> lock(mutex_);
+				wake_.wait(lock, [&] { return stop_ || generation_ != generation; });
+				if (stop_)
+					return;
+				generation = generation_;
+			}
+
+			work();
+
+			lock_guard<mutex> lock(mutex_);
+			if (--busy_ == 0)
+				done_.notify_one();
+		}
+	}
+
+	void WorkerPool::work()
+	{
+		int begin;
+		while ((begin = next_.fetch_add(grain_)) < n_)
+			call_(f_, begin, min(begin + grain_, n_));
+	}
+
+} // namespace carnd